@@ -94,6 +94,12 @@ namespace DNAAlphabet {
             }
             return *this;
         }
+        bool operator==(const AlphaCount<Storage>& c) const {
+            return std::equal(_data, _data + size(), c._data);
+        }
+        bool operator!=(const AlphaCount<Storage>& c) const {
+            return !(*this == c);
+        }
     private:
         template <class T>
         friend std::ostream& operator<<(std::ostream& stream, const AlphaCount<T>& c);
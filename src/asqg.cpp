@@ -23,9 +23,11 @@ namespace ASQG {
     static const std::string ERRRATE_TAG("ER");
     static const std::string CONTAINMENT_TAG("CN");
     static const std::string TRANSITIVE_TAG("TE");
+    // static const std::string SHARD_TAG("SH");
 
     // Vertex tags
     static const std::string SUBSTRING_TAG("SS");
+    static const std::string ABORTED_TAG("AB");
     // static const std::string BARCODE_TAG("BX");
 
     // Edge tags
@@ -81,6 +83,10 @@ namespace ASQG {
                 if (!record._transitive.fromstring(fields[i])) {
                     return false;
                 }
+            } else if (boost::algorithm::starts_with(fields[i], SHARD_TAG)) {
+                if (!record._shard.fromstring(fields[i])) {
+                    return false;
+                }
             }
         }
         
@@ -107,6 +113,9 @@ namespace ASQG {
         if (record._transitive) {
             fields.push_back(record._transitive.tostring(TRANSITIVE_TAG));
         }
+        if (record._shard) {
+            fields.push_back(record._shard.tostring(SHARD_TAG));
+        }
 
         stream << HEAD_TAG;
         for (const auto& item : fields) {
@@ -148,6 +157,10 @@ namespace ASQG {
                 if (!record.substring.fromstring(fields[i])) {
                     return false;
                 }
+            } else if (boost::algorithm::starts_with(fields[i], ABORTED_TAG)) {
+                if (!record.aborted.fromstring(fields[i])) {
+                    return false;
+                }
             } else if (boost::algorithm::starts_with(fields[i], BARCODE_TAG)) {
                 if (!record.barcode.fromstring(fields[i])) {
                     return false;
@@ -162,6 +175,9 @@ namespace ASQG {
         if (record.substring) {
             stream << FIELD_SEP << record.substring.tostring(SUBSTRING_TAG);
         }
+        if (record.aborted) {
+            stream << FIELD_SEP << record.aborted.tostring(ABORTED_TAG);
+        }
         if (record.barcode) {
             stream << FIELD_SEP << record.barcode.tostring(BARCODE_TAG);
         }
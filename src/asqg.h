@@ -14,6 +14,7 @@ namespace ASQG {
     const char FIELD_SEP = '\t';
     const char TAG_SEP = ':';
     const std::string BARCODE_TAG = "BX";
+    const std::string SHARD_TAG = "SH";
 
     enum RecordType {
         RT_NONE = -1, 
@@ -113,6 +114,13 @@ namespace ASQG {
         const IntTagValue& transitive() const {
             return _transitive;
         }
+        // I/N for the output of the I-th of N shards
+        void shard(const std::string& v) {
+            _shard = v;
+        }
+        const StringTagValue& shard() const {
+            return _shard;
+        }
     private:
         friend std::ostream& operator<<(std::ostream& stream, const HeaderRecord& record);
         friend std::istream& operator>>(std::istream& stream, HeaderRecord& record);
@@ -123,6 +131,7 @@ namespace ASQG {
         IntTagValue _overlap;
         IntTagValue _containment;
         IntTagValue _transitive;
+        StringTagValue _shard;
     };
 
     // A vertex record is an id, sequence and an array of
@@ -139,6 +148,7 @@ namespace ASQG {
         std::string id;
         std::string seq;
         IntTagValue substring;
+        IntTagValue aborted; // optional, the overlap search hit a work limit
         StringTagValue barcode; // optional
     private:
         friend std::ostream& operator<<(std::ostream& stream, const VertexRecord& record);
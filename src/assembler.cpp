@@ -230,7 +230,8 @@ private:
                 "                                       this helps save memory by culling excessive edges around unresolvable repeats (default: 128)\n"
                 "          --init-vertex-capacity=INT   the initail capacity for veritices in bigraph INT (default 0)\n"
                 "      -t, --threads=NUM                use NUM threads to construct the paired graph (default: 1)\n"
-                "          --batch-size=NUM             use NUM batches for each thread (default: 1000)\n"
+                "          --batch-size=NUM             process at most NUM vertices at once in each thread, the size adapts to the cost of\n"
+                "                                       the vertices below NUM (default: 1000)\n"
                 "\n"
                 "Paired reads parameters:\n"
                 "          --pe-mode=INT                0 - do not treat reads as paired (default)\n"
@@ -0,0 +1,594 @@
+#include "bgzf.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <ios>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
+
+// The input of a block, small enough for the compressed block to stay below
+// 64KB even when the data does not compress
+static const size_t kBlockSize = 0xff00;
+static const size_t kMaxBlockSize = 0x10000;
+static const size_t kHeaderSize = 18;
+static const size_t kFooterSize = 8;
+
+// An empty block marks the end of the file
+static const unsigned char kEOF[28] = {
+    0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 0x42, 0x43,
+    0x02, 0x00, 0x1b, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+static void pack16(unsigned char* p, uint32_t v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+}
+
+static void pack32(unsigned char* p, uint32_t v) {
+    pack16(p, v);
+    pack16(p + 2, v >> 16);
+}
+
+static uint32_t unpack16(const unsigned char* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t unpack32(const unsigned char* p) {
+    return unpack16(p) | (unpack16(p + 2) << 16);
+}
+
+// Whether header starts a BGZF block
+static bool isBlock(const unsigned char* header) {
+    return header[0] == 0x1f && header[1] == 0x8b && header[2] == 0x08 && (header[3] & 0x04) != 0 
+        && unpack16(header + 10) == 6 && header[12] == 'B' && header[13] == 'C' && unpack16(header + 14) == 2;
+}
+
+// Deflate data into a complete BGZF block, false if it does not fit
+static bool deflateBlock(const std::string& data, std::string& block, int level) {
+    block.resize(kMaxBlockSize);
+    unsigned char* p = reinterpret_cast<unsigned char *>(&block[0]);
+
+    z_stream zs;
+    zs.zalloc = Z_NULL;
+    zs.zfree = Z_NULL;
+    zs.opaque = Z_NULL;
+    if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    zs.avail_in = data.size();
+    zs.next_out = p + kHeaderSize;
+    zs.avail_out = kMaxBlockSize - kHeaderSize - kFooterSize;
+    int r = deflate(&zs, Z_FINISH);
+    size_t size = zs.total_out;
+    deflateEnd(&zs);
+    if (r != Z_STREAM_END) {
+        return false;
+    }
+    size += kHeaderSize + kFooterSize;
+
+    // gzip header with the BC extra field holding the block size - 1
+    static const unsigned char header[] = {0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 0x42, 0x43, 0x02, 0x00};
+    std::copy(header, header + sizeof(header), p);
+    pack16(p + 16, size - 1);
+
+    uint32_t crc = crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef *>(data.data()), data.size());
+    pack32(p + size - kFooterSize, crc);
+    pack32(p + size - 4, data.size());
+
+    block.resize(size);
+    return true;
+}
+
+// Inflate a complete BGZF block into data, false if it is corrupted
+static bool inflateBlock(const std::string& block, std::string& data) {
+    const unsigned char* p = reinterpret_cast<const unsigned char *>(block.data());
+    size_t size = block.size();
+    uint32_t crc = unpack32(p + size - kFooterSize), isize = unpack32(p + size - 4);
+    data.resize(isize);
+
+    z_stream zs;
+    zs.zalloc = Z_NULL;
+    zs.zfree = Z_NULL;
+    zs.opaque = Z_NULL;
+    if (inflateInit2(&zs, -15) != Z_OK) {
+        return false;
+    }
+    char empty;
+    zs.next_in = const_cast<Bytef *>(p + kHeaderSize);
+    zs.avail_in = size - kHeaderSize - kFooterSize;
+    zs.next_out = reinterpret_cast<Bytef *>(isize > 0 ? &data[0] : &empty);
+    zs.avail_out = std::max(isize, 1u);
+    int r = inflate(&zs, Z_FINISH);
+    size_t length = zs.total_out;
+    inflateEnd(&zs);
+
+    return r == Z_STREAM_END && length == isize && crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef *>(data.data()), isize) == crc;
+}
+
+// The compression threads of all the writers and readers, created on first use
+static const size_t kMaxThreads = 8;
+static size_t poolThreads = 0;
+
+static ThreadPool& pool() {
+    static ThreadPool pool(BGZFSink::threads());
+    return pool;
+}
+
+//
+// BGZFSink::Writer
+//
+class BGZFSink::Writer {
+public:
+    Writer(const std::string& filename) : _stream(filename.c_str(), std::ios::binary), _closed(false) {
+        if (!_stream) {
+            throw std::ios_base::failure("bgzf: failed to create " + filename);
+        }
+        _current = block();
+    }
+    ~Writer() {
+        try {
+            close();
+        } catch (...) {
+        }
+    }
+
+    void write(const char* s, size_t n) {
+        while (n > 0) {
+            size_t k = std::min(n, kBlockSize - _current->data.size());
+            _current->data.append(s, k);
+            s += k;
+            n -= k;
+            if (_current->data.size() == kBlockSize) {
+                submit();
+            }
+        }
+    }
+
+    void close() {
+        if (_closed) {
+            return;
+        }
+        _closed = true;
+        if (!_current->data.empty()) {
+            submit();
+        }
+        flush(0);
+        _stream.write(reinterpret_cast<const char *>(kEOF), sizeof(kEOF));
+        _stream.close();
+        if (!_stream) {
+            throw std::ios_base::failure("bgzf: failed to write");
+        }
+    }
+private:
+    struct Block {
+        Block() : done(false) {
+            data.reserve(kBlockSize);
+        }
+        std::string data;
+        std::string compressed;
+        bool done;
+    };
+    typedef std::shared_ptr<Block> BlockPtr;
+
+    BlockPtr block() {
+        if (_free.empty()) {
+            return BlockPtr(new Block());
+        }
+        BlockPtr block = _free.back();
+        _free.pop_back();
+        return block;
+    }
+
+    void submit() {
+        BlockPtr block = _current;
+        _pending.push_back(block);
+        _current = this->block();
+
+        pool().submit([this, block] {
+                if (!deflateBlock(block->data, block->compressed, Z_DEFAULT_COMPRESSION)) {
+                    // Stored blocks always fit
+                    deflateBlock(block->data, block->compressed, 0);
+                }
+                std::lock_guard<std::mutex> lock(_mutex);
+                block->done = true;
+                _done.notify_all();
+            });
+
+        // Keep the pool busy but bound the memory
+        flush(4 * pool().size());
+    }
+
+    // Write the compressed blocks in order until at most n are pending
+    void flush(size_t n) {
+        while (!_pending.empty()) {
+            BlockPtr block = _pending.front();
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (_pending.size() > n) {
+                    _done.wait(lock, [&block] { return block->done; });
+                } else if (!block->done) {
+                    break;
+                }
+            }
+            _stream.write(block->compressed.data(), block->compressed.size());
+            _pending.pop_front();
+
+            block->data.clear();
+            block->done = false;
+            _free.push_back(block);
+        }
+        if (!_stream) {
+            throw std::ios_base::failure("bgzf: failed to write");
+        }
+    }
+
+    std::ofstream _stream;
+    BlockPtr _current;
+    std::deque<BlockPtr> _pending;
+    std::vector<BlockPtr> _free;
+    bool _closed;
+    std::mutex _mutex;
+    std::condition_variable _done;
+};
+
+//
+// BGZFSink
+//
+BGZFSink::BGZFSink(const std::string& filename) : _writer(new Writer(filename)) {
+}
+
+std::streamsize BGZFSink::write(const char* s, std::streamsize n) {
+    _writer->write(s, n);
+    return n;
+}
+
+void BGZFSink::close() {
+    _writer->close();
+}
+
+void BGZFSink::threads(size_t n) {
+    poolThreads = n;
+}
+
+size_t BGZFSink::threads() {
+    return poolThreads > 0 ? poolThreads : std::min(std::max(std::thread::hardware_concurrency(), 1u), (unsigned)kMaxThreads);
+}
+
+//
+// BGZFSource::Reader
+//
+class BGZFSource::Reader {
+public:
+    Reader(const std::string& filename) : _stream(filename.c_str(), std::ios::binary), _tasks(0), _position(0), _skip(0) {
+        if (!_stream) {
+            throw std::ios_base::failure("bgzf: failed to open " + filename);
+        }
+        unsigned char header[kHeaderSize];
+        _stream.read(reinterpret_cast<char *>(header), kHeaderSize);
+        _bgzf = (_stream.gcount() == kHeaderSize && isBlock(header));
+        start(0, 0);
+    }
+    ~Reader() {
+        stop();
+    }
+
+    std::streamsize read(char* s, std::streamsize n) {
+        std::streamsize copied = 0;
+        while (copied < n) {
+            if (!_current) {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _ready.wait(lock, [this] { return !_error.empty() || (!_blocks.empty() && _blocks.front()->done) || (_blocks.empty() && _eof); });
+                if (!_error.empty()) {
+                    throw std::ios_base::failure(_error);
+                }
+                if (_blocks.empty()) {
+                    break;
+                }
+                _current = _blocks.front();
+                _blocks.pop_front();
+                _used = 0;
+                _vacant.notify_all();
+            }
+
+            size_t k = _current->data.size() - _used;
+            if (_skip > 0) {
+                k = std::min(k, _skip);
+                _skip -= k;
+            } else {
+                k = std::min(k, (size_t)(n - copied));
+                std::copy(_current->data.begin() + _used, _current->data.begin() + _used + k, s + copied);
+                copied += k;
+            }
+            _used += k;
+            _position += k;
+
+            if (_used == _current->data.size()) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _free.push_back(_current);
+                _current.reset();
+            }
+        }
+        return copied > 0 ? copied : -1;
+    }
+
+    std::streampos seek(boost::iostreams::stream_offset off, std::ios_base::seekdir way) {
+        size_t position = _position + _skip;
+        if (way == std::ios_base::beg) {
+            position = off;
+        } else if (way == std::ios_base::cur) {
+            position += off;
+        } else {
+            throw std::ios_base::failure("bgzf: can not seek from the end");
+        }
+        if (position == _position + _skip) {
+            return position;
+        }
+
+        // Restart at the last indexed block before the target and skip the rest
+        stop();
+        std::pair<size_t, size_t> start(0, 0);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = std::upper_bound(_index.begin(), _index.end(), std::make_pair(position, (size_t)-1));
+            if (it != _index.begin()) {
+                start = *(--it);
+            }
+        }
+        this->start(start.second, start.first);
+        _skip = position - start.first;
+        return position;
+    }
+
+    void close() {
+        stop();
+    }
+private:
+    struct Block {
+        Block() : done(false) {
+        }
+        std::string compressed;
+        std::string data;
+        bool done;
+    };
+    typedef std::shared_ptr<Block> BlockPtr;
+
+    // Read ahead from the compressed offset coffset, which is the uncompressed
+    // offset uoffset
+    void start(size_t coffset, size_t uoffset) {
+        for (const auto& block : _blocks) {
+            _free.push_back(block);
+        }
+        _blocks.clear();
+        if (_current) {
+            _free.push_back(_current);
+            _current.reset();
+        }
+        _eof = _stop = false;
+        _error.clear();
+        _position = uoffset;
+        _skip = 0;
+
+        _stream.clear();
+        _stream.seekg(coffset);
+        if (_bgzf) {
+            _thread = std::thread(&Reader::readBlocks, this, coffset, uoffset);
+        } else {
+            _thread = std::thread(&Reader::inflateStream, this);
+        }
+    }
+
+    // Stop reading ahead and wait for the blocks being decoded
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+            _vacant.notify_all();
+        }
+        if (_thread.joinable()) {
+            _thread.join();
+        }
+        std::unique_lock<std::mutex> lock(_mutex);
+        _ready.wait(lock, [this] { return _tasks == 0; });
+    }
+
+    BlockPtr block() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_free.empty()) {
+            return BlockPtr(new Block());
+        }
+        BlockPtr block = _free.back();
+        _free.pop_back();
+        block->done = false;
+        return block;
+    }
+
+    // Queue a block, waits while too many are queued. False if stopped.
+    bool push(BlockPtr block, size_t limit) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _vacant.wait(lock, [this, limit] { return _stop || _blocks.size() < limit; });
+        if (_stop) {
+            return false;
+        }
+        _blocks.push_back(block);
+        if (!block->done) {
+            ++_tasks;
+        }
+        _ready.notify_all();
+        return true;
+    }
+
+    void finish(const std::string& error) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_error.empty()) {
+            _error = error;
+        }
+        _eof = true;
+        _ready.notify_all();
+    }
+
+    // Read the BGZF blocks and decode them on the pool
+    void readBlocks(size_t coffset, size_t uoffset) {
+        size_t limit = 4 * pool().size() + 4;
+        while (true) {
+            unsigned char header[kHeaderSize];
+            _stream.read(reinterpret_cast<char *>(header), kHeaderSize);
+            if (_stream.gcount() == 0) {
+                break;
+            }
+            if (_stream.gcount() != kHeaderSize || !isBlock(header)) {
+                finish("bgzf: invalid block header");
+                return;
+            }
+
+            BlockPtr block = this->block();
+            size_t size = unpack16(header + 16) + 1;
+            block->compressed.resize(size);
+            std::copy(header, header + kHeaderSize, block->compressed.begin());
+            _stream.read(&block->compressed[kHeaderSize], size - kHeaderSize);
+            if (_stream.gcount() != (std::streamsize)(size - kHeaderSize)) {
+                finish("bgzf: truncated block");
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (_index.empty() || _index.back().first < uoffset) {
+                    _index.push_back(std::make_pair(uoffset, coffset));
+                }
+            }
+            coffset += size;
+            uoffset += unpack32(reinterpret_cast<const unsigned char *>(&block->compressed[size - 4]));
+
+            if (!push(block, limit)) {
+                return;
+            }
+            pool().submit([this, block] {
+                    bool r = inflateBlock(block->compressed, block->data);
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    if (!r && _error.empty()) {
+                        _error = "bgzf: corrupted block";
+                    }
+                    block->done = true;
+                    --_tasks;
+                    _ready.notify_all();
+                });
+        }
+        finish("");
+    }
+
+    // Inflate a gzip file of any number of members into large blocks
+    void inflateStream() {
+        static const size_t kChunkSize = 1 << 20;
+
+        z_stream zs;
+        zs.zalloc = Z_NULL;
+        zs.zfree = Z_NULL;
+        zs.opaque = Z_NULL;
+        zs.next_in = Z_NULL;
+        zs.avail_in = 0;
+        if (inflateInit2(&zs, 15 + 16) != Z_OK) {
+            finish("gzip: failed to initialize");
+            return;
+        }
+
+        std::vector<char> input(kChunkSize);
+        BlockPtr block;
+        int r = Z_STREAM_END;
+        std::string error;
+        while (true) {
+            if (!block) {
+                block = this->block();
+                block->data.resize(kChunkSize);
+                zs.next_out = reinterpret_cast<Bytef *>(&block->data[0]);
+                zs.avail_out = kChunkSize;
+            }
+            if (zs.avail_in == 0) {
+                _stream.read(input.data(), input.size());
+                if (_stream.gcount() == 0) {
+                    if (r != Z_STREAM_END) {
+                        error = "gzip: truncated file";
+                    }
+                    break;
+                }
+                zs.next_in = reinterpret_cast<Bytef *>(input.data());
+                zs.avail_in = _stream.gcount();
+            }
+            if (r == Z_STREAM_END) {
+                // The next member
+                inflateReset(&zs);
+            }
+            r = inflate(&zs, Z_NO_FLUSH);
+            if (r != Z_OK && r != Z_STREAM_END) {
+                error = "gzip: corrupted file";
+                break;
+            }
+            if (zs.avail_out == 0) {
+                block->done = true;
+                if (!push(block, 4)) {
+                    inflateEnd(&zs);
+                    return;
+                }
+                block.reset();
+            }
+        }
+        inflateEnd(&zs);
+
+        if (block && error.empty()) {
+            block->data.resize(kChunkSize - zs.avail_out);
+            block->done = true;
+            if (!push(block, 4)) {
+                return;
+            }
+        }
+        finish(error);
+    }
+
+    std::ifstream _stream;
+    bool _bgzf;
+
+    // Read ahead
+    std::thread _thread;
+    std::deque<BlockPtr> _blocks;
+    std::vector<BlockPtr> _free;
+    size_t _tasks;
+    bool _eof;
+    bool _stop;
+    std::string _error;
+    std::mutex _mutex;
+    std::condition_variable _ready;
+    std::condition_variable _vacant;
+
+    // The uncompressed and compressed offsets of the blocks
+    std::vector<std::pair<size_t, size_t> > _index;
+
+    // The block being read, at uncompressed offset _position
+    BlockPtr _current;
+    size_t _used;
+    size_t _position;
+    size_t _skip;
+};
+
+//
+// BGZFSource
+//
+BGZFSource::BGZFSource(const std::string& filename) : _reader(new Reader(filename)) {
+}
+
+std::streamsize BGZFSource::read(char* s, std::streamsize n) {
+    return _reader->read(s, n);
+}
+
+std::streampos BGZFSource::seek(boost::iostreams::stream_offset off, std::ios_base::seekdir way) {
+    return _reader->seek(off, way);
+}
+
+void BGZFSource::close() {
+    _reader->close();
+}
@@ -0,0 +1,68 @@
+#ifndef bgzf_h_
+#define bgzf_h_
+
+#include <iosfwd>
+#include <memory>
+#include <string>
+
+#include <boost/iostreams/categories.hpp>
+#include <boost/iostreams/positioning.hpp>
+
+//
+// BGZF - Blocked gzip as used by samtools: a series of gzip members of at most
+// 64KB each, every one carrying its compressed size in a 'BC' extra field, and
+// an empty member marking the end of the file. Any gzip tool reads it as a
+// plain gzip file.
+//
+// BGZFSink - A boost::iostreams sink writing a BGZF file. The blocks are
+// compressed in parallel on a thread pool shared by all the sinks and written
+// in order.
+//
+class BGZFSink {
+public:
+    typedef char char_type;
+    struct category : boost::iostreams::sink_tag, boost::iostreams::closable_tag {};
+
+    // Throws std::ios_base::failure if filename can not be created
+    BGZFSink(const std::string& filename);
+
+    std::streamsize write(const char* s, std::streamsize n);
+    void close();
+
+    // Size the pool shared by the sinks and the sources, only before the first
+    // file is opened (default: the number of processors, at most 8). The other
+    // multithreaded codecs use as many threads.
+    static void threads(size_t n);
+    static size_t threads();
+private:
+    class Writer;
+    // Devices are copied by the streams
+    std::shared_ptr<Writer> _writer;
+};
+
+//
+// BGZFSource - A boost::iostreams source reading a gzip file on its own thread
+// ahead of the caller. The blocks of a BGZF file are decoded in parallel on the
+// shared pool, other gzip files are inflated by the read ahead thread.
+//
+// The source is seekable: the offsets of the BGZF blocks are indexed as they
+// are read, so a seek restarts at the nearest block before the target. A plain
+// gzip file is inflated again from the start.
+//
+class BGZFSource {
+public:
+    typedef char char_type;
+    struct category : boost::iostreams::input_seekable, boost::iostreams::device_tag, boost::iostreams::closable_tag {};
+
+    // Throws std::ios_base::failure if filename can not be opened
+    BGZFSource(const std::string& filename);
+
+    std::streamsize read(char* s, std::streamsize n);
+    std::streampos seek(boost::iostreams::stream_offset off, std::ios_base::seekdir way);
+    void close();
+private:
+    class Reader;
+    std::shared_ptr<Reader> _reader;
+};
+
+#endif // bgzf_h_
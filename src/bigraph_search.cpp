@@ -3,7 +3,6 @@
 
 #include <unordered_set>
 
-#include <boost/algorithm/string.hpp>
 
 size_t BigraphWalk::build(NodePtrQueue& Q, const Vertex* end, size_t minDistance, size_t maxDistance, size_t maxNodes, NodePtrList* leaves) {
     size_t num = 0;
@@ -98,13 +97,33 @@ bool BigraphWalk::hasLink(const Vertex* v1, const Vertex* v2, int distance, Edge
         }
     }
     assert(distance >= 0);
-    std::string seq1 = v1->seq(), seq2 = v2->seq();
-    if (comp == Edge::EC_REVERSE) {
-        make_dna_reverse_complement(seq2);
+    // Compare the bases in place, v2 is read backwards and complemented on
+    // the reverse strand
+    const std::string& seq1 = v1->seq(), & seq2 = v2->seq();
+    size_t n1 = seq1.length(), n2 = seq2.length(), d = distance;
+    auto base2 = [&seq2, n2, comp](size_t i) {
+        return comp == Edge::EC_REVERSE ? make_dna_complement(seq2[n2 - i - 1]) : seq2[i];
+    };
+    if (dir == Edge::ED_SENSE) {
+        // seq2 starts with seq1[distance:]
+        if (d >= n1 || n1 - d > n2) {
+            return false;
+        }
+        for (size_t i = d; i < n1; ++i) {
+            if (seq1[i] != base2(i - d)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    // seq1 starts with seq2[distance:]
+    if (d >= n2 || n2 - d > n1) {
+        return false;
+    }
+    for (size_t i = d; i < n2; ++i) {
+        if (base2(i) != seq1[i - d]) {
+            return false;
+        }
     }
-    return (
-                dir == Edge::ED_SENSE && distance < seq1.length() && boost::algorithm::starts_with(seq2, seq1.substr(distance))
-            ) || (
-                dir == Edge::ED_ANTISENSE && distance < seq2.length()  && boost::algorithm::starts_with(seq1, seq2.substr(distance))
-            );
+    return true;
 }
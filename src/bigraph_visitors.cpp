@@ -923,7 +923,6 @@ void PairedReadVisitor::postvisit(Bigraph* graph) {
     for (size_t i = 0; i < proclist.size(); ++i) {
         proclist[i] = new PairedVertexProcess(graph, this);
     }
-#ifdef _OPENMP
     if (_threads > 1) {
         SequenceProcessFramework::ParallelWorker<
             const Vertex*, 
@@ -931,21 +930,18 @@ void PairedReadVisitor::postvisit(Bigraph* graph) {
             SequenceProcessFramework::VectorWorkItemGenerator<const Vertex *>, 
             PairedVertexProcess, 
             PairedVertexPostProcess
-            > worker;
+            > worker("paired-reads");
         size_t num = worker.run(generator, &proclist, &postproc, _batch);
     } else { // single thread
-#endif // _OPENMP
         SequenceProcessFramework::SerialWorker<
             const Vertex*, 
             BigraphWalk::NodePtrList, 
             SequenceProcessFramework::VectorWorkItemGenerator<const Vertex *>, 
             PairedVertexProcess, 
             PairedVertexPostProcess
-            > worker;
+            > worker("paired-reads");
         size_t num = worker.run(generator, proclist[0], &postproc);
-#ifdef _OPENMP
     }
-#endif // _OPENMP
     for (size_t i = 0; i < proclist.size(); ++i) {
         delete proclist[i];
     }
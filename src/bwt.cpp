@@ -26,6 +26,44 @@ BWT::BWT(const SuffixArray& sa, const DNASeqList& sequences) : _strings(sa.strin
     }
 }
 
+void BWT::erase(const std::vector<size_t>& positions) {
+    RLString runs;
+    RLUnit run;
+    size_t i = 0, k = 0;
+    for (const auto& unit : _runs) {
+        char c = unit;
+        for (size_t n = 0; n < unit.count(); ++n, ++i) {
+            if (k < positions.size() && positions[k] == i) {
+                assert(k == 0 || positions[k - 1] < i);
+                if (c == '$') {
+                    --_strings;
+                }
+                ++k;
+                continue;
+            }
+
+            // Merge the symbols left around the removed ones into the same run
+            if (run.initialized()) {
+                if (run == c && !run.full()) {
+                    ++run;
+                } else {
+                    runs.push_back(run);
+                    run = RLUnit(c);
+                }
+            } else {
+                run = RLUnit(c);
+            }
+        }
+    }
+    if (run.initialized()) {
+        runs.push_back(run);
+    }
+    assert(k == positions.size());
+
+    _runs.swap(runs);
+    _suffixes -= positions.size();
+}
+
 const uint16_t BWT_FILE_MAGIC = 0xCACA;
 
 enum BWFlag {       
@@ -5,6 +5,7 @@
 #include "rlstring.h"
 
 #include <iostream>
+#include <vector>
 
 class SuffixArray;
 
@@ -23,6 +24,13 @@ public:
     size_t length() const {
         return _suffixes;
     }
+    size_t strings() const {
+        return _strings;
+    }
+
+    // Remove the symbols at the positions (sorted, no duplicates) in a single pass
+    // over the runs. Every '$' removed drops a string from the collection.
+    void erase(const std::vector<size_t>& positions);
 private:
     friend std::ostream& operator<<(std::ostream& stream, const BWT& bwt);
     friend std::istream& operator>>(std::istream& stream, BWT& bwt);
@@ -0,0 +1,281 @@
+#include "codec.h"
+#include "bgzf.h"
+
+#include <algorithm>
+#include <fstream>
+#include <ios>
+#include <vector>
+
+#ifdef HAVE_ZSTD_H
+#include <zstd.h>
+#endif
+#ifdef HAVE_LZ4FRAME_H
+#include <lz4frame.h>
+#endif
+
+#ifdef HAVE_ZSTD_H
+//
+// ZstdSink::Writer
+//
+class ZstdSink::Writer {
+public:
+    Writer(const std::string& filename, int level) : _stream(filename.c_str(), std::ios::binary), _buffer(ZSTD_CStreamOutSize()), _closed(false) {
+        if (!_stream) {
+            throw std::ios_base::failure("zstd: failed to create " + filename);
+        }
+        _ctx = ZSTD_createCCtx();
+        ZSTD_CCtx_setParameter(_ctx, ZSTD_c_compressionLevel, level);
+        // As many workers as the gzip files, fails without effect if libzstd
+        // is single threaded
+        ZSTD_CCtx_setParameter(_ctx, ZSTD_c_nbWorkers, BGZFSink::threads());
+    }
+    ~Writer() {
+        try {
+            close();
+        } catch (...) {
+        }
+        ZSTD_freeCCtx(_ctx);
+    }
+
+    void write(const char* s, size_t n) {
+        ZSTD_inBuffer input = {s, n, 0};
+        while (input.pos < input.size) {
+            compress(&input, ZSTD_e_continue);
+        }
+    }
+
+    void close() {
+        if (_closed) {
+            return;
+        }
+        _closed = true;
+        ZSTD_inBuffer input = {NULL, 0, 0};
+        while (compress(&input, ZSTD_e_end) != 0) {
+        }
+        _stream.close();
+        if (!_stream) {
+            throw std::ios_base::failure("zstd: failed to write");
+        }
+    }
+private:
+    // Returns what is left to flush
+    size_t compress(ZSTD_inBuffer* input, ZSTD_EndDirective mode) {
+        ZSTD_outBuffer output = {_buffer.data(), _buffer.size(), 0};
+        size_t r = ZSTD_compressStream2(_ctx, &output, input, mode);
+        if (ZSTD_isError(r)) {
+            throw std::ios_base::failure(std::string("zstd: ") + ZSTD_getErrorName(r));
+        }
+        if (!_stream.write(_buffer.data(), output.pos)) {
+            throw std::ios_base::failure("zstd: failed to write");
+        }
+        return r;
+    }
+
+    std::ofstream _stream;
+    std::vector<char> _buffer;
+    ZSTD_CCtx* _ctx;
+    bool _closed;
+};
+
+//
+// ZstdSource::Reader
+//
+class ZstdSource::Reader {
+public:
+    Reader(const std::string& filename) : _stream(filename.c_str(), std::ios::binary), _buffer(ZSTD_DStreamInSize()), _remaining(0), _flushing(false) {
+        if (!_stream) {
+            throw std::ios_base::failure("zstd: failed to open " + filename);
+        }
+        _ctx = ZSTD_createDCtx();
+        _input.src = _buffer.data();
+        _input.size = _input.pos = 0;
+    }
+    ~Reader() {
+        ZSTD_freeDCtx(_ctx);
+    }
+
+    std::streamsize read(char* s, std::streamsize n) {
+        ZSTD_outBuffer output = {s, (size_t)n, 0};
+        while (output.pos < output.size) {
+            // A full output may leave data in the context, get it before reading on
+            if (_input.pos == _input.size && !_flushing) {
+                _stream.read(_buffer.data(), _buffer.size());
+                if (_stream.gcount() == 0) {
+                    if (_remaining != 0) {
+                        throw std::ios_base::failure("zstd: truncated file");
+                    }
+                    break;
+                }
+                _input.size = _stream.gcount();
+                _input.pos = 0;
+            }
+            _remaining = ZSTD_decompressStream(_ctx, &output, &_input);
+            if (ZSTD_isError(_remaining)) {
+                throw std::ios_base::failure(std::string("zstd: ") + ZSTD_getErrorName(_remaining));
+            }
+            _flushing = (output.pos == output.size);
+        }
+        return output.pos > 0 ? output.pos : -1;
+    }
+private:
+    std::ifstream _stream;
+    std::vector<char> _buffer;
+    ZSTD_DCtx* _ctx;
+    ZSTD_inBuffer _input;
+    size_t _remaining; // 0 at the end of a frame
+    bool _flushing;
+};
+
+ZstdSink::ZstdSink(const std::string& filename, int level) : _writer(new Writer(filename, level)) {
+}
+
+std::streamsize ZstdSink::write(const char* s, std::streamsize n) {
+    _writer->write(s, n);
+    return n;
+}
+
+void ZstdSink::close() {
+    _writer->close();
+}
+
+ZstdSource::ZstdSource(const std::string& filename) : _reader(new Reader(filename)) {
+}
+
+std::streamsize ZstdSource::read(char* s, std::streamsize n) {
+    return _reader->read(s, n);
+}
+#endif // HAVE_ZSTD_H
+
+#ifdef HAVE_LZ4FRAME_H
+static void check(size_t r) {
+    if (LZ4F_isError(r)) {
+        throw std::ios_base::failure(std::string("lz4: ") + LZ4F_getErrorName(r));
+    }
+}
+
+//
+// LZ4Sink::Writer
+//
+class LZ4Sink::Writer {
+public:
+    Writer(const std::string& filename) : _stream(filename.c_str(), std::ios::binary), _closed(false) {
+        if (!_stream) {
+            throw std::ios_base::failure("lz4: failed to create " + filename);
+        }
+        check(LZ4F_createCompressionContext(&_ctx, LZ4F_VERSION));
+        // Large enough for the header, a chunk and the end mark
+        _buffer.resize(std::max(LZ4F_compressBound(kChunkSize, NULL), (size_t)LZ4F_HEADER_SIZE_MAX));
+        flush(LZ4F_compressBegin(_ctx, _buffer.data(), _buffer.size(), NULL));
+    }
+    ~Writer() {
+        try {
+            close();
+        } catch (...) {
+        }
+        LZ4F_freeCompressionContext(_ctx);
+    }
+
+    void write(const char* s, size_t n) {
+        while (n > 0) {
+            size_t k = std::min(n, kChunkSize);
+            flush(LZ4F_compressUpdate(_ctx, _buffer.data(), _buffer.size(), s, k, NULL));
+            s += k;
+            n -= k;
+        }
+    }
+
+    void close() {
+        if (_closed) {
+            return;
+        }
+        _closed = true;
+        flush(LZ4F_compressEnd(_ctx, _buffer.data(), _buffer.size(), NULL));
+        _stream.close();
+        if (!_stream) {
+            throw std::ios_base::failure("lz4: failed to write");
+        }
+    }
+private:
+    static const size_t kChunkSize = 1 << 16;
+
+    void flush(size_t r) {
+        check(r);
+        if (!_stream.write(_buffer.data(), r)) {
+            throw std::ios_base::failure("lz4: failed to write");
+        }
+    }
+
+    std::ofstream _stream;
+    std::vector<char> _buffer;
+    LZ4F_compressionContext_t _ctx;
+    bool _closed;
+};
+
+//
+// LZ4Source::Reader
+//
+class LZ4Source::Reader {
+public:
+    Reader(const std::string& filename) : _stream(filename.c_str(), std::ios::binary), _buffer(1 << 16), _pos(0), _size(0), _remaining(0), _flushing(false) {
+        if (!_stream) {
+            throw std::ios_base::failure("lz4: failed to open " + filename);
+        }
+        check(LZ4F_createDecompressionContext(&_ctx, LZ4F_VERSION));
+    }
+    ~Reader() {
+        LZ4F_freeDecompressionContext(_ctx);
+    }
+
+    std::streamsize read(char* s, std::streamsize n) {
+        size_t copied = 0;
+        while (copied < (size_t)n) {
+            // A full output may leave data in the context, get it before reading on
+            if (_pos == _size && !_flushing) {
+                _stream.read(_buffer.data(), _buffer.size());
+                if (_stream.gcount() == 0) {
+                    if (_remaining != 0) {
+                        throw std::ios_base::failure("lz4: truncated file");
+                    }
+                    break;
+                }
+                _size = _stream.gcount();
+                _pos = 0;
+            }
+            size_t length = n - copied, consumed = _size - _pos;
+            _remaining = LZ4F_decompress(_ctx, s + copied, &length, _buffer.data() + _pos, &consumed, NULL);
+            check(_remaining);
+            copied += length;
+            _pos += consumed;
+            _flushing = (copied == (size_t)n);
+        }
+        return copied > 0 ? copied : -1;
+    }
+private:
+    std::ifstream _stream;
+    std::vector<char> _buffer;
+    size_t _pos;
+    size_t _size;
+    LZ4F_decompressionContext_t _ctx;
+    size_t _remaining; // 0 at the end of a frame
+    bool _flushing;
+};
+
+LZ4Sink::LZ4Sink(const std::string& filename) : _writer(new Writer(filename)) {
+}
+
+std::streamsize LZ4Sink::write(const char* s, std::streamsize n) {
+    _writer->write(s, n);
+    return n;
+}
+
+void LZ4Sink::close() {
+    _writer->close();
+}
+
+LZ4Source::LZ4Source(const std::string& filename) : _reader(new Reader(filename)) {
+}
+
+std::streamsize LZ4Source::read(char* s, std::streamsize n) {
+    return _reader->read(s, n);
+}
+#endif // HAVE_LZ4FRAME_H
@@ -0,0 +1,94 @@
+#ifndef codec_h_
+#define codec_h_
+
+#include "config.h"
+
+#include <iosfwd>
+#include <memory>
+#include <string>
+
+#include <boost/iostreams/categories.hpp>
+
+//
+// Fast codecs for the intermediate files, which are written once and read
+// back by the same command, so speed matters much more than the ratio. They
+// are boost::iostreams devices over a file, like BGZFSink and BGZFSource.
+//
+// The codecs are only built in when configure finds the libraries.
+//
+#ifdef HAVE_ZSTD_H
+//
+// ZstdSink - Writes a zstd frame at a fast level, compressed on as many workers
+// as BGZFSink::threads() if libzstd is multithreaded.
+//
+class ZstdSink {
+public:
+    typedef char char_type;
+    struct category : boost::iostreams::sink_tag, boost::iostreams::closable_tag {};
+
+    // Throws std::ios_base::failure if filename can not be created
+    ZstdSink(const std::string& filename, int level=1);
+
+    std::streamsize write(const char* s, std::streamsize n);
+    void close();
+private:
+    class Writer;
+    std::shared_ptr<Writer> _writer;
+};
+
+//
+// ZstdSource - Reads any number of zstd frames.
+//
+class ZstdSource {
+public:
+    typedef char char_type;
+    typedef boost::iostreams::source_tag category;
+
+    // Throws std::ios_base::failure if filename can not be opened
+    ZstdSource(const std::string& filename);
+
+    std::streamsize read(char* s, std::streamsize n);
+private:
+    class Reader;
+    std::shared_ptr<Reader> _reader;
+};
+#endif // HAVE_ZSTD_H
+
+#ifdef HAVE_LZ4FRAME_H
+//
+// LZ4Sink - Writes an lz4 frame at the default (fastest) level.
+//
+class LZ4Sink {
+public:
+    typedef char char_type;
+    struct category : boost::iostreams::sink_tag, boost::iostreams::closable_tag {};
+
+    // Throws std::ios_base::failure if filename can not be created
+    LZ4Sink(const std::string& filename);
+
+    std::streamsize write(const char* s, std::streamsize n);
+    void close();
+private:
+    class Writer;
+    std::shared_ptr<Writer> _writer;
+};
+
+//
+// LZ4Source - Reads any number of lz4 frames.
+//
+class LZ4Source {
+public:
+    typedef char char_type;
+    typedef boost::iostreams::source_tag category;
+
+    // Throws std::ios_base::failure if filename can not be opened
+    LZ4Source(const std::string& filename);
+
+    std::streamsize read(char* s, std::streamsize n);
+private:
+    class Reader;
+    std::shared_ptr<Reader> _reader;
+};
+#endif // HAVE_LZ4FRAME_H
+
+#endif // codec_h_
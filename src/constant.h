@@ -11,9 +11,12 @@
 #define HITS_EXT  ".hits"
 #define GZIP_EXT  ".gz"
 #define BZIP_EXT  ".bz2"
+#define ZSTD_EXT  ".zst"
+#define LZ4_EXT   ".lz4"
 #define RMDUP_EXT ".rmdup"
 #define EC_EXT    ".ec"
 #define FA_EXT    ".fa"
+#define TMP_EXT   ".tmp"
 
 // command sorting
 enum {
@@ -21,6 +24,7 @@ enum {
     kIndex, 
     kCorrect, 
     kOverlap, 
+    kOverlapMerge, 
     kAssemble, 
     kSubgraph, 
     kRmDup, 
@@ -3,6 +3,7 @@
 #include "correct_processor.h"
 #include "fmindex.h"
 #include "runner.h"
+#include "worker_stats.h"
 
 #include <iostream>
 #include <memory>
@@ -39,6 +40,8 @@ public:
             prefix = options.get<std::string>("prefix");
         }
 
+        WorkerStats::sampleInterval(options.get<double>("stats-interval", 0));
+
         FMIndex fmi;
         if (FMIndex::load(prefix + BWT_EXT, fmi)) {
             // Prepare parameters
@@ -54,6 +57,14 @@ public:
             r = -1;
         }
 
+        if (r == 0 && options.find("stats") != options.not_found()) {
+            std::string statsfile = options.get<std::string>("stats");
+            if (!WorkerStats::write(statsfile)) {
+                LOG4CXX_ERROR(logger, boost::format("Failed to write stats to %s") % statsfile);
+                r = -1;
+            }
+        }
+
         return r;
     }
 
@@ -78,6 +89,8 @@ private:
                 "      -o, --outfile=FILE               write the corrected reads to FILE (default READFILE%s%s)\n"
                 "      -t, --threads=NUM                use NUM threads for the computation (default: %d)\n"
                 "      -a, --algorithm=STR              specify the correction algorithm to use. STR must be one of kmer,overlap. (default: %s)\n"
+                "          --stats=FILE                 write the throughput and latency counters of the workers to FILE as JSON\n"
+                "          --stats-interval=SEC         log the counters every SEC seconds while running (default: 0, never)\n"
                 "\n"
                 "      -k, --kmer-size=N                the length of the kmer to user (default: %d)\n"
                 "      -x, --kmer-threshold=N           attempt to correct kmers that are seen less than N times (default: %d)\n"
@@ -92,7 +105,7 @@ private:
 };
 
 static const std::string shortopts = "c:s:p:o:t:a:k:x:i:O:h";
-enum { OPT_HELP = 1};
+enum { OPT_HELP = 1, OPT_STATS, OPT_STATS_INTERVAL };
 static const option longopts[] = {
     {"log4cxx",             required_argument,  NULL, 'c'}, 
     {"ini",                 required_argument,  NULL, 's'}, 
@@ -104,6 +117,8 @@ static const option longopts[] = {
     {"kmer-threshold",      required_argument,  NULL, 'x'}, 
     {"kmer-rounds",         required_argument,  NULL, 'i'}, 
     {"kmer-count-offset",   required_argument,  NULL, 'O'}, 
+    {"stats",               required_argument,  NULL, OPT_STATS}, 
+    {"stats-interval",      required_argument,  NULL, OPT_STATS_INTERVAL}, 
     {"help",                no_argument,        NULL, 'h'}, 
     {NULL, 0, NULL, 0}, 
 };
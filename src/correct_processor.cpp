@@ -1,4 +1,5 @@
 #include "correct_processor.h"
+#include "kmer.h"
 #include "sequence_process_framework.h"
 #include "utils.h"
 
@@ -96,6 +97,13 @@ public:
             minPhredVector[i - k] = ps;
         }
 
+        // The kmers without N are cached by their packed bases
+        bool packable = k <= Kmer::kMaxSize;
+        PackedSeq packed;
+        if (packable) {
+            packed.assign(seq);
+        }
+        std::unordered_map<Kmer, size_t> packedCache;
         std::unordered_map<std::string, size_t> kmerCache;
         bool allSolid = false;
         size_t rounds = 0;
@@ -108,17 +116,27 @@ public:
             std::vector<int> solidVector(n, 0);
 
             for (size_t i = k; i <= n; ++i) {
-                std::string kmer = seq.substr(i - k, k);
-
                 // First check if this kmer is in the cache
                 // If its not, find its count from the fm-index and cache it
                 size_t count = 0;
-                auto iter = kmerCache.find(kmer);
-                if (iter != kmerCache.end()) {
-                    count = iter->second;
+                if (packable && !packed.masked(i - k, k)) {
+                    Kmer kmer = packed.kmer(i - k, k);
+                    auto iter = packedCache.find(kmer);
+                    if (iter != packedCache.end()) {
+                        count = iter->second;
+                    } else {
+                        count = FMIndex::Interval::occurrences(kmer, &_index);
+                        packedCache[kmer] = count;
+                    }
                 } else {
-                    count = FMIndex::Interval::occurrences(kmer, &_index);
-                    kmerCache[kmer] = count;
+                    std::string kmer = seq.substr(i - k, k);
+                    auto iter = kmerCache.find(kmer);
+                    if (iter != kmerCache.end()) {
+                        count = iter->second;
+                    } else {
+                        count = FMIndex::Interval::occurrences(kmer, &_index);
+                        kmerCache[kmer] = count;
+                    }
                 }
 
                 // Get the phred score for the last base of the kmer
@@ -146,7 +164,8 @@ public:
 
             // Attempt to correct the leftmost potentially incorrect base
             bool corrected = false;
-            for (size_t i = 0; i < n; ++i) {
+            size_t i = 0;
+            for (; i < n; ++i) {
                 if (!solidVector[i]) {
                     int phred = item.read.score(i);
                     size_t threshold = CorrectThreshold::get()->requiredSupport(phred);
@@ -164,6 +183,10 @@ public:
                 }
             }
 
+            if (corrected && packable) {
+                packed.set(i, seq[i]);
+            }
+
             // If no base in the read was corrected, stop the correction process
             if (!corrected) {
                 assert(!allSolid);
@@ -187,17 +210,30 @@ private:
         assert(kmerIdx <= baseIdx && baseIdx < kmerIdx + _kmerSize);
         size_t deltaIdx = baseIdx - kmerIdx;
         char currBase = read[baseIdx];
-        std::string kmer = read.substr(kmerIdx, _kmerSize);
         size_t bestCount = 0;
         char bestBase = '$';
 
-        LOG4CXX_DEBUG(logger, boost::format("baseIdx: %d kmerIdx: %d %s %s") % baseIdx % kmerIdx % kmer % make_dna_reverse_complement_copy(kmer));
+        LOG4CXX_DEBUG(logger, boost::format("baseIdx: %d kmerIdx: %d %s") % baseIdx % kmerIdx % read.substr(kmerIdx, _kmerSize));
+
+        // The bases to the right of the candidate position are shared by all the
+        // substitutions, search them once and branch on the candidate base
+        FMIndex::Interval suffix(0, _index.length() - 1);
+        for (size_t j = _kmerSize; j > deltaIdx + 1 && suffix.valid(); --j) {
+            suffix.update(read[kmerIdx + j - 1], &_index);
+        }
+        FMIndex::Interval children[DNAAlphabet::ALL_SIZE];
+        if (suffix.valid()) {
+            suffix.extendAll(&_index, children);
+        }
 
         for (size_t i = 0; i < DNAAlphabet::size; ++i) {
             char c = DNAAlphabet::DNA[i];
             if (c != currBase) {
-                kmer[deltaIdx] = c;
-                size_t count = FMIndex::Interval::occurrences(kmer, &_index);
+                FMIndex::Interval interval = children[DNAAlphabet::torank(c)];
+                for (size_t j = deltaIdx; j > 0 && interval.valid(); --j) {
+                    interval.update(read[kmerIdx + j - 1], &_index);
+                }
+                size_t count = interval.size();
                 LOG4CXX_DEBUG(logger, boost::format("%c %lu") % c % count);
                 if (count >= minCount) {
                     if (bestBase != '$') {
@@ -247,15 +283,16 @@ public:
     }
     void process(const SequenceProcessFramework::SequenceWorkItem& workItem, const CorrectResult& result) {
         if (result.validQC) {
-            DNASeq read = workItem.read;
-            read.seq = result.seq;
-            _stream << read;
+            _read = workItem.read;
+            _read.seq = result.seq;
+            _stream << _read;
         }
     }
 
 private:
     std::ostream& _stream;
     std::ostream* _discard;
+    DNASeq _read; // reused for every output read
 };
 
 bool CorrectProcessor::process(const FMIndex& index, DNASeqReader& reader, std::ostream& output, size_t threads, size_t* processed) const {
@@ -272,14 +309,13 @@ bool CorrectProcessor::process(const FMIndex& index, DNASeqReader& reader, std::
             SequenceProcessFramework::SequenceWorkItemGenerator<SequenceProcessFramework::SequenceWorkItem>, 
             AbstractCorrector, 
             PostCorrector
-            > worker;
+            > worker("correct");
         size_t num = worker.run(reader, proc.get(), &postproc);
         if (processed != NULL) {
             *processed = num;
         }
         return true;
     } else {
-#ifdef _OPENMP
         std::vector<AbstractCorrector *> proclist(threads);
         for (size_t i = 0; i < threads; ++i) {
             proclist[i] = AbstractCorrector::create(index, _options);
@@ -295,7 +331,7 @@ bool CorrectProcessor::process(const FMIndex& index, DNASeqReader& reader, std::
             SequenceProcessFramework::SequenceWorkItemGenerator<SequenceProcessFramework::SequenceWorkItem>, 
             AbstractCorrector, 
             PostCorrector
-            > worker;
+            > worker("correct");
         size_t num = worker.run(reader, &proclist, &postproc);
         if (processed != NULL) {
             *processed = num;
@@ -305,26 +341,29 @@ bool CorrectProcessor::process(const FMIndex& index, DNASeqReader& reader, std::
             delete proclist[i];
         }
         return true;
-#else
-        LOG4CXX_ERROR(logger, "failed to load OpenMP");
-        assert(false);
-#endif // _OPENMP
     }
     return false;
 }
 
 bool CorrectProcessor::process(const FMIndex& index, const std::string& input, const std::string& output, size_t threads, size_t* processed) const {
 
-    // DNASeqReader
-    std::shared_ptr<std::istream> reads(Utils::ifstream(input));
-    if (!reads) {
-        LOG4CXX_ERROR(logger, boost::format("Failed to read file %s") % input);
-        return false;
+    // DNASeqReader, a plain file is parsed on the threads too
+    std::shared_ptr<std::istream> reads;
+    std::shared_ptr<DNASeqReader> reader;
+    if (threads > 1) {
+        reader.reset(DNASeqReaderFactory::create(input, threads));
     }
-    std::shared_ptr<DNASeqReader> reader(DNASeqReaderFactory::create(*reads));
     if (!reader) {
-        LOG4CXX_ERROR(logger, boost::format("Failed to create DNASeqReader %s") % input);
-        return false;
+        reads.reset(Utils::ifstream(input));
+        if (!reads) {
+            LOG4CXX_ERROR(logger, boost::format("Failed to read file %s") % input);
+            return false;
+        }
+        reader.reset(DNASeqReaderFactory::create(*reads));
+        if (!reader) {
+            LOG4CXX_ERROR(logger, boost::format("Failed to create DNASeqReader %s") % input);
+            return false;
+        }
     }
 
     std::shared_ptr<std::ostream> out(Utils::ofstream(output));
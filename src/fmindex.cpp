@@ -181,44 +181,27 @@ public:
         // so we increment the index by 1.
         ++i;
 
-        LargeMarker lmarker = nearest(i);
-        size_t position = lmarker.total();
-
-        DNAAlphabet::AlphaCount64 counts = lmarker.counts;
-        size_t currIdx = lmarker.unitIndex;
-
-        // Search forwards (towards 0) until idx is found
-        while (position < i) {
-            size_t delta = i - position;
+        Cursor cursor(nearest(i));
+        seek(cursor, i);
+        return cursor.at(_runs, i);
+    }
 
-            assert(currIdx < _runs.size());
+    // Resolve the ranks at both ends of an interval. The second one is walked from
+    // where the first one stopped unless they are more than a sample apart.
+    void find(size_t l, size_t u, DNAAlphabet::AlphaCount64* lcounts, DNAAlphabet::AlphaCount64* ucounts) const {
+        assert(lcounts != NULL && ucounts != NULL);
 
-            const RLUnit& run = _runs[currIdx++];
-            size_t n = run.count();
-            if (n > delta) {
-                n = delta;
-            }
-            counts[DNAAlphabet::torank((char)run)] += n;
-            position += n;
-        }
-        // Search backwards (towards 0) until idx is found
-        while (position > i) {
-            size_t delta = position - i;
+        ++l, ++u;
 
-            assert(currIdx <= _runs.size());
+        Cursor cursor(nearest(l));
+        seek(cursor, l);
+        *lcounts = cursor.at(_runs, l);
 
-            const RLUnit& run = _runs[--currIdx];
-            size_t n = run.count();
-            if (n > delta) {
-                n = delta;
-            }
-            counts[DNAAlphabet::torank((char)run)] -= n;
-            position -= n;
+        if ((u > l ? u - l : l - u) > _sampleRate) {
+            cursor = Cursor(nearest(u));
         }
-        
-        assert(position == i);
-
-        return counts;
+        seek(cursor, u);
+        *ucounts = cursor.at(_runs, u);
     }
 
     char getChar(size_t i) const {
@@ -237,6 +220,47 @@ public:
     }
 
 private:
+    // A position in the runs which is always at the start of a run: position is
+    // the number of symbols in the runs before unitIndex and counts their occurrences
+    struct Cursor {
+        Cursor(const LargeMarker& marker) : counts(marker.counts), position(marker.total()), unitIndex(marker.unitIndex) {
+        }
+
+        // The occurrences before i, which must be within the run at unitIndex
+        DNAAlphabet::AlphaCount64 at(const RLString& runs, size_t i) const {
+            DNAAlphabet::AlphaCount64 occ = counts;
+            if (i > position) {
+                assert(unitIndex < runs.size() && i - position < runs[unitIndex].count());
+                occ[DNAAlphabet::torank((char)runs[unitIndex])] += i - position;
+            }
+            return occ;
+        }
+
+        DNAAlphabet::AlphaCount64 counts;
+        size_t position;
+        size_t unitIndex;
+    };
+
+    // Move the cursor to the run containing i
+    void seek(Cursor& cursor, size_t i) const {
+        // Search backwards (towards 0) until the run starts at or before i
+        while (cursor.position > i) {
+            assert(cursor.unitIndex > 0);
+
+            const RLUnit& run = _runs[--cursor.unitIndex];
+            cursor.counts[DNAAlphabet::torank((char)run)] -= run.count();
+            cursor.position -= run.count();
+        }
+        // Search forwards until the run ends after i
+        while (cursor.unitIndex < _runs.size() && cursor.position + _runs[cursor.unitIndex].count() <= i) {
+            const RLUnit& run = _runs[cursor.unitIndex++];
+            cursor.counts[DNAAlphabet::torank((char)run)] += run.count();
+            cursor.position += run.count();
+        }
+
+        assert(cursor.position <= i);
+    }
+
     LargeMarker nearest(size_t i) const {
         size_t baseIdx = i / _sampleRate; 
         size_t offset = MOD_POWER_2(i, _sampleRate); // equivalent to position % sampleRate
@@ -313,6 +337,11 @@ DNAAlphabet::AlphaCount64 FMIndex::getOcc(size_t i) const {
     return finder.find(i);
 }
 
+void FMIndex::getOcc2(size_t l, size_t u, DNAAlphabet::AlphaCount64* lcounts, DNAAlphabet::AlphaCount64* ucounts) const {
+    MarkerFind finder(_bwt.str(), _lmarkers, _smarkers, _sampleRate);
+    finder.find(l, u, lcounts, ucounts);
+}
+
 std::ostream& operator<<(std::ostream& stream, const FMIndex& index) {
     stream << index._bwt;
     /*
@@ -63,7 +63,9 @@ public:
     public:
         Interval(size_t l = 0, size_t u = -1) : lower(l), upper(u) {
         }
-        static Interval get(const std::string& w, const FMIndex* index) {
+        // w is a std::string or any sequence of bases with size() and [], like a Kmer
+        template <class Sequence>
+        static Interval get(const Sequence& w, const FMIndex* index) {
             Interval interval;
 
             size_t j = w.size();
@@ -76,12 +78,9 @@ public:
 
             return interval;
         }
-        static size_t occurrences(const std::string& w, const FMIndex* index) {
-            Interval interval = get(w, index);
-            if (interval.valid()) {
-                return interval.upper - interval.lower + 1;
-            }
-            return 0;
+        template <class Sequence>
+        static size_t occurrences(const Sequence& w, const FMIndex* index) {
+            return get(w, index).size();
         }
         bool valid() const {
             return upper != -1 && upper >= lower;
@@ -91,12 +90,31 @@ public:
             upper = lower + index->getOcc(c, index->length() - 1) - 1;
         }
         void update(char c, const FMIndex* index) {
+            DNAAlphabet::AlphaCount64 l, u;
+            index->getOcc2(lower - 1, upper, &l, &u);
             size_t pb = index->getPC(c);
-            lower = pb + index->getOcc(c, lower - 1);
-            upper = pb + index->getOcc(c, upper) - 1;
+            lower = pb + l[DNAAlphabet::torank(c)];
+            upper = pb + u[DNAAlphabet::torank(c)] - 1;
         }
         DNAAlphabet::AlphaCount64 ext(const FMIndex* index) const {
-            return index->getOcc(upper) - index->getOcc(lower - 1);
+            DNAAlphabet::AlphaCount64 l, u;
+            index->getOcc2(lower - 1, upper, &l, &u);
+            return u - l;
+        }
+        // Extend the interval to the left with every symbol ($ACGT) at once.
+        // The child for symbol c is stored at children[DNAAlphabet::torank(c)],
+        // all of them are derived from the same two rank queries.
+        void extendAll(const FMIndex* index, Interval children[DNAAlphabet::ALL_SIZE]) const {
+            DNAAlphabet::AlphaCount64 l, u;
+            index->getOcc2(lower - 1, upper, &l, &u);
+            for (size_t i = 0; i < DNAAlphabet::ALL_SIZE; ++i) {
+                size_t pb = index->getPC(DNAAlphabet::tochar(i));
+                children[i].lower = pb + l[i];
+                children[i].upper = pb + u[i] - 1;
+            }
+        }
+        size_t size() const {
+            return valid() ? upper - lower + 1 : 0;
         }
         bool operator==(const Interval& o) const {
             return lower == o.lower && upper == o.upper;
@@ -129,10 +147,16 @@ public:
     }
     size_t getOcc(char c, size_t i) const;
     DNAAlphabet::AlphaCount64 getOcc(size_t i) const;
+    // The occurrences at both ends of an interval, l is usually lower-1 and u upper.
+    // Narrow intervals share a single marker lookup and run walk.
+    void getOcc2(size_t l, size_t u, DNAAlphabet::AlphaCount64* lcounts, DNAAlphabet::AlphaCount64* ucounts) const;
 
     size_t length() const {
         return _bwt.length();
     }
+    size_t strings() const {
+        return _bwt.strings();
+    }
 
     void info() const;
 
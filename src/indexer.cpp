@@ -1,11 +1,15 @@
 #include "bwt.h"
 #include "config.h"
 #include "constant.h"
+#include "fmindex.h"
 #include "kseq.h"
 #include "runner.h"
 #include "suffix_array.h"
 #include "suffix_array_builder.h"
+#include "utils.h"
 
+#include <algorithm>
+#include <cassert>
 #include <iostream>
 #include <memory>
 
@@ -13,11 +17,82 @@
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
 
 #include <log4cxx/logger.h>
 
 static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("arcs.Indexer"));
 
+//
+// DuplicateFinder - Find the reads that are identical to or contained in another
+// read using the suffix array of all the reads. The suffixes equal to a read are
+// adjacent to its full-length suffix, followed by the suffixes it is a prefix of.
+// Only the forward strand is considered.
+//
+class DuplicateFinder {
+public:
+    DuplicateFinder(const SuffixArray& sa, const DNASeqList& reads) : _sa(sa), _reads(reads) {
+    }
+
+    // Set keep[i] to false for the removed reads, copies[i] is the number of
+    // reads identical to read i (including itself), or 0 if read i is contained
+    // in a longer read as rmdup reports. Returns the number of removed reads.
+    size_t find(std::vector<bool>* keep, std::vector<size_t>* copies) const {
+        assert(keep != NULL && copies != NULL);
+
+        keep->assign(_reads.size(), true);
+        copies->assign(_reads.size(), 1);
+
+        size_t removed = 0;
+        for (size_t k = 0, end = 0; k < _sa.size(); ++k) {
+            if (k < end || !_sa[k].full()) {
+                continue;
+            }
+            const std::string& seq = _reads[_sa[k].i].seq;
+
+            // A suffix of another read equal to this one
+            bool contained = k > 0 && equals(_sa[k - 1], seq);
+
+            // The identical reads
+            std::vector<size_t> group;
+            for (end = k; end < _sa.size() && equals(_sa[end], seq); ++end) {
+                if (_sa[end].full()) {
+                    group.push_back(_sa[end].i);
+                } else {
+                    contained = true;
+                }
+            }
+
+            // Some read has this one as a proper prefix of one of its suffixes
+            contained = contained || (end < _sa.size() && startsWith(_sa[end], seq));
+
+            // Keep the first of the identical reads unless they are all contained
+            size_t first = *std::min_element(group.begin(), group.end());
+            for (auto i : group) {
+                (*copies)[i] = contained ? 0 : group.size();
+                if (contained || i != first) {
+                    (*keep)[i] = false;
+                    ++removed;
+                }
+            }
+        }
+        return removed;
+    }
+
+private:
+    bool equals(const SuffixArray::Elem& elem, const std::string& seq) const {
+        const std::string& other = _reads[elem.i].seq;
+        return other.length() - elem.j == seq.length() && other.compare(elem.j, seq.length(), seq) == 0;
+    }
+    bool startsWith(const SuffixArray::Elem& elem, const std::string& seq) const {
+        const std::string& other = _reads[elem.i].seq;
+        return other.length() - elem.j >= seq.length() && other.compare(elem.j, seq.length(), seq) == 0;
+    }
+
+    const SuffixArray& _sa;
+    const DNASeqList& _reads;
+};
+
 class Indexer : public Runner {
 public:
     int run(const Properties& options, const Arguments& arguments) {
@@ -36,16 +111,39 @@ public:
         }
         LOG4CXX_INFO(logger, boost::format("output: %s.(%s|%s|%s|%s)") % output % SAI_EXT % BWT_EXT % RSAI_EXT % RBWT_EXT);
 
+        if (options.find("remove") != options.not_found()) {
+            std::string dupfile = options.get<std::string>("remove");
+            LOG4CXX_INFO(logger, boost::format("remove: %s") % dupfile);
+            if (!remove(options, dupfile, output)) {
+                LOG4CXX_ERROR(logger, boost::format("Failed to remove reads %s from index %s") % dupfile % output);
+                r = -1;
+            }
+            return r;
+        }
+
         std::string algorithm = options.get<std::string>("algorithm", "sais");
         LOG4CXX_INFO(logger, boost::format("algorithm: %s") % algorithm);
 
+        size_t threads = options.get<size_t>("threads", 1);
+
         DNASeqList reads;
-        if (ReadDNASequences(input, reads)) {
+        if (ReadDNASequences(input, reads, threads)) {
             std::shared_ptr<SuffixArrayBuilder> builder(SuffixArrayBuilder::create(algorithm));
             if (builder) {
-                size_t threads = options.get<size_t>("threads", 1);
                 // forward
-                if (options.find("no-forward") == options.not_found()) {
+                if (options.find("rmdup") != options.not_found()) {
+                    // The duplicates are found in the forward suffix array, the index
+                    // is built over the kept reads only
+                    std::shared_ptr<SuffixArray> sa(builder->build(reads, threads));
+                    if (!sa || !rmdup(sa.get(), &reads, output + RMDUP_EXT + FA_EXT, output + RMDUP_EXT + ".dups" + FA_EXT)) {
+                        LOG4CXX_ERROR(logger, boost::format("Failed to remove duplicates from reads %s") % input);
+                        return -1;
+                    }
+                    if (options.find("no-forward") == options.not_found() && !write(*sa, reads, output + SAI_EXT, output + BWT_EXT)) {
+                        LOG4CXX_ERROR(logger, boost::format("Failed to write index %s") % output);
+                        r = -1;
+                    }
+                } else if (options.find("no-forward") == options.not_found()) {
                     build(builder.get(), reads, threads, output + SAI_EXT, output + BWT_EXT);
                 }
 
@@ -70,23 +168,49 @@ public:
     }
 
 private:
+    // A read to remove from the index
+    struct Removal {
+        Removal(size_t rank, const std::string& seq) : rank(rank), seq(seq) {
+        }
+        bool operator<(const Removal& o) const {
+            return rank < o.rank;
+        }
+        bool operator==(const Removal& o) const {
+            return rank == o.rank;
+        }
+        size_t rank;
+        std::string seq;
+    };
+    // A suffix array and its bwt with the removed reads erased
+    struct PrunedIndex {
+        PrunedIndex(const std::string& safile, const std::string& bwtfile, bool reverse) : safile(safile), bwtfile(bwtfile), reverse(reverse) {
+        }
+        std::string safile;
+        std::string bwtfile;
+        bool reverse;
+        std::shared_ptr<SuffixArray> sa;
+        BWT bwt;
+    };
+
     bool build(SuffixArrayBuilder* builder, const DNASeqList& reads, size_t threads, const std::string& safile, const std::string& bwtfile) {
         std::shared_ptr<SuffixArray> sa(builder->build(reads, threads));
         if (!sa) {
             return false;
         }
-
+        return write(*sa, reads, safile, bwtfile);
+    }
+    bool write(const SuffixArray& sa, const DNASeqList& reads, const std::string& safile, const std::string& bwtfile) {
         // suffix array
         {
             boost::filesystem::ofstream out(safile);
-            out << *sa;
+            out << sa;
             if (!out) {
                 return false;
             }
         }
         // bwt
         {
-            BWT bwt(*sa, reads);
+            BWT bwt(sa, reads);
             boost::filesystem::ofstream out(bwtfile);
             out << bwt;
             if (!out) {
@@ -96,6 +220,171 @@ private:
         return true;
     }
 
+    // Remove the identical and contained reads from the reads and the suffix array,
+    // the kept reads and the removed ones are written as rmdup does.
+    bool rmdup(SuffixArray* sa, DNASeqList* reads, const std::string& output, const std::string& duplicates) {
+        std::vector<bool> keep;
+        std::vector<size_t> copies;
+        DuplicateFinder finder(*sa, *reads);
+        size_t removed = finder.find(&keep, &copies);
+        LOG4CXX_INFO(logger, boost::format("%d of %d reads are duplicated or contained") % removed % reads->size());
+
+        std::shared_ptr<std::ostream> fasta(Utils::ofstream(output)), dups(Utils::ofstream(duplicates));
+        if (!fasta || !dups) {
+            LOG4CXX_ERROR(logger, boost::format("Failed to create %s or %s") % output % duplicates);
+            return false;
+        }
+
+        size_t n = 0;
+        for (size_t i = 0; i < reads->size(); ++i) {
+            const DNASeq& read = (*reads)[i];
+            std::string meta = boost::str(boost::format("%s NumDuplicates=%d") % read.name % copies[i]);
+            if (keep[i]) {
+                *fasta << DNASeq(boost::str(boost::format("%s %s") % read.name % meta), read.seq);
+                (*reads)[n++] = read;
+            } else {
+                *dups << DNASeq(boost::str(boost::format("%s,seqrank=%d %s") % read.name % i % meta), read.seq);
+            }
+        }
+        reads->resize(n);
+
+        sa->filter(keep);
+        return (bool)*fasta && (bool)*dups;
+    }
+
+    // Remove the reads listed in the duplicate file written by rmdup from an
+    // existing index. The reads are identified by their seqrank.
+    bool remove(const Properties& options, const std::string& dupfile, const std::string& output) {
+        DNASeqList dups;
+        if (!ReadDNASequences(dupfile, dups)) {
+            LOG4CXX_ERROR(logger, boost::format("Failed to open input stream %s") % dupfile);
+            return false;
+        }
+
+        std::vector<Removal> removals;
+        for (const auto& read : dups) {
+            size_t pos = read.name.find(",seqrank=");
+            if (pos == std::string::npos) {
+                LOG4CXX_ERROR(logger, boost::format("No seqrank for read %s") % read.name);
+                return false;
+            }
+            try {
+                removals.push_back(Removal(boost::lexical_cast<size_t>(read.name.substr(pos + 9)), read.seq));
+            } catch (boost::bad_lexical_cast&) {
+                LOG4CXX_ERROR(logger, boost::format("Invalid seqrank for read %s") % read.name);
+                return false;
+            }
+        }
+        std::sort(removals.begin(), removals.end());
+        removals.erase(std::unique(removals.begin(), removals.end()), removals.end());
+        LOG4CXX_INFO(logger, boost::format("%d reads to remove") % removals.size());
+
+        std::vector<PrunedIndex> indexes;
+        if (options.find("no-forward") == options.not_found()) {
+            indexes.push_back(PrunedIndex(output + SAI_EXT, output + BWT_EXT, false));
+        }
+        if (options.find("no-reverse") == options.not_found()) {
+            indexes.push_back(PrunedIndex(output + RSAI_EXT, output + RBWT_EXT, true));
+        }
+
+        // Every index is checked before any file is touched, then the files are
+        // written aside and renamed once all of them are complete
+        for (auto& index : indexes) {
+            if (!prune(removals, &index)) {
+                return false;
+            }
+        }
+        std::vector<std::pair<std::string, std::string> > renames;
+        bool written = true;
+        for (const auto& index : indexes) {
+            renames.push_back(std::make_pair(index.safile + TMP_EXT, index.safile));
+            renames.push_back(std::make_pair(index.bwtfile + TMP_EXT, index.bwtfile));
+            {
+                boost::filesystem::ofstream out(index.safile + TMP_EXT);
+                written = written && (out << *index.sa);
+            }
+            {
+                boost::filesystem::ofstream out(index.bwtfile + TMP_EXT);
+                written = written && (out << index.bwt);
+            }
+            if (!written) {
+                LOG4CXX_ERROR(logger, boost::format("Failed to write index %s or %s") % index.safile % index.bwtfile);
+                break;
+            }
+        }
+        for (const auto& file : renames) {
+            boost::system::error_code ec;
+            if (written) {
+                boost::filesystem::rename(file.first, file.second, ec);
+                if (ec) {
+                    LOG4CXX_ERROR(logger, boost::format("Failed to rename %s to %s: %s") % file.first % file.second % ec.message());
+                    written = false;
+                }
+            } else {
+                boost::filesystem::remove(file.first, ec);
+            }
+        }
+        return written;
+    }
+
+    bool prune(const std::vector<Removal>& removals, PrunedIndex* pruned) {
+        const std::string& safile = pruned->safile, & bwtfile = pruned->bwtfile;
+        std::shared_ptr<SuffixArray> sa(SuffixArray::load(safile));
+        if (!sa) {
+            LOG4CXX_ERROR(logger, boost::format("Failed to load suffix array %s") % safile);
+            return false;
+        }
+        BWT& bwt = pruned->bwt;
+        {
+            boost::filesystem::ifstream in(bwtfile);
+            if (!(in >> bwt) || bwt.strings() != sa->strings()) {
+                LOG4CXX_ERROR(logger, boost::format("Failed to load bwt %s") % bwtfile);
+                return false;
+            }
+        }
+
+        // Walk LF from the '$' of every read, which is at the row of its index as the
+        // suffixes are sorted by the index of their reads when they are equal. The
+        // symbols met spell the read backwards and end with its own '$'.
+        std::vector<size_t> positions;
+        std::vector<bool> keep(sa->strings(), true);
+        {
+            FMIndex index(bwt);
+            for (const auto& removal : removals) {
+                if (removal.rank >= index.strings()) {
+                    LOG4CXX_ERROR(logger, boost::format("seqrank %d is out of the index %s") % removal.rank % bwtfile);
+                    return false;
+                }
+
+                std::string seq;
+                size_t row = removal.rank;
+                char c = index.getChar(row);
+                positions.push_back(row);
+                while (c != '$' && seq.length() <= removal.seq.length()) {
+                    seq.push_back(c);
+                    row = index.getPC(c) + index.getOcc(c, row) - 1;
+                    c = index.getChar(row);
+                    positions.push_back(row);
+                }
+                if (!pruned->reverse) {
+                    std::reverse(seq.begin(), seq.end());
+                }
+                if (seq != removal.seq) {
+                    LOG4CXX_ERROR(logger, boost::format("Read with seqrank %d does not match the index %s") % removal.rank % bwtfile);
+                    return false;
+                }
+                keep[removal.rank] = false;
+            }
+        }
+
+        std::sort(positions.begin(), positions.end());
+        bwt.erase(positions);
+        sa->filter(keep);
+        assert(bwt.strings() == sa->strings());
+        pruned->sa = sa;
+        return true;
+    }
+
     Indexer(const std::string& name, const std::string& description, const std::string& shortopts, const option* longopts) : Runner(shortopts, longopts) {
         RUNNER_INSTALL(name, this, description, kIndex);
     }
@@ -121,6 +410,11 @@ private:
                 "          --no-reverse                 suppress construction of the reverse BWT. Use this option when building the index\n"
                 "                                       for reads that will be error corrected using the k-mer corrector, which only needs the forward index\n"
                 "          --no-forward                 suppress construction of the forward BWT. Use this option when building the forward and reverse index separately\n"
+                "          --remove=FILE                remove the reads in FILE, the duplicates written by rmdup, from the existing index\n"
+                "                                       PREFIX in place. The reads are located by the seqrank in their names\n"
+                "          --rmdup                      remove the reads identical to or contained in another read (forward strand only) while\n"
+                "                                       indexing. The kept reads are written to PREFIX.rmdup.fa, the others to PREFIX.rmdup.dups.fa\n"
+                "                                       and the index is built over the kept reads\n"
                 "\n"
                 ) % PACKAGE_NAME << std::endl;
         return 256;
@@ -130,7 +424,7 @@ private:
 };
 
 static const std::string shortopts = "c:s:a:t:p:g:h";
-enum { OPT_HELP = 1, OPT_NO_REVERSE, OPT_NO_FORWARD };
+enum { OPT_HELP = 1, OPT_NO_REVERSE, OPT_NO_FORWARD, OPT_RMDUP, OPT_REMOVE };
 static const option longopts[] = {
     {"log4cxx",             required_argument,  NULL, 'c'}, 
     {"ini",                 required_argument,  NULL, 's'}, 
@@ -139,6 +433,8 @@ static const option longopts[] = {
     {"algorithm",           required_argument,  NULL, 'a'}, 
     {"no-reverse",          no_argument,        NULL, OPT_NO_REVERSE}, 
     {"no-forward",          no_argument,        NULL, OPT_NO_FORWARD}, 
+    {"rmdup",               no_argument,        NULL, OPT_RMDUP}, 
+    {"remove",              required_argument,  NULL, OPT_REMOVE}, 
     {"help",                no_argument,        NULL, 'h'}, 
     {NULL, 0, NULL, 0}, 
 };
@@ -0,0 +1,232 @@
+#ifndef kmer_h_
+#define kmer_h_
+
+#include "alphabet.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+//
+// Kmer - Up to 32 bases packed 2 bits each (A=0, C=1, G=2, T=3) in a word,
+// the first base in the highest bits, so that the words order the k-mers of
+// one size like their strings.
+//
+class Kmer {
+public:
+    typedef uint64_t Word;
+    static const size_t kMaxSize = 32;
+
+    Kmer(size_t k=0, Word bits=0) : _bits(bits), _size(k) {
+        assert(k <= kMaxSize);
+    }
+
+    // The 2 bit code of c, -1 if it is not one of ACGT
+    static int code(char c) {
+        return DNAAlphabet::torank(c) - 1;
+    }
+
+    // Returns false if s has a base other than ACGT
+    static bool pack(const char* s, size_t k, Kmer* kmer) {
+        assert(k <= kMaxSize);
+        Word bits = 0;
+        for (size_t i = 0; i < k; ++i) {
+            int b = code(s[i]);
+            if (b < 0) {
+                return false;
+            }
+            bits = (bits << 2) | b;
+        }
+        *kmer = Kmer(k, bits);
+        return true;
+    }
+
+    size_t size() const {
+        return _size;
+    }
+    Word bits() const {
+        return _bits;
+    }
+    char operator[](size_t i) const {
+        assert(i < _size);
+        return DNAAlphabet::DNA[(_bits >> (2 * (_size - i - 1))) & 3];
+    }
+    std::string str() const {
+        std::string s(_size, 0);
+        for (size_t i = 0; i < _size; ++i) {
+            s[i] = (*this)[i];
+        }
+        return s;
+    }
+
+    // Shift the base with code b in at the end, dropping the first one
+    void push(int b) {
+        _bits = ((_bits << 2) | b) & mask(_size);
+    }
+
+    Kmer reverseComplement() const {
+        if (_size == 0) {
+            return *this;
+        }
+        // The complement of a code is 3 - code, then the pairs of bits are
+        // reversed by swapping ever larger groups
+        Word x = ~_bits;
+        x = ((x >> 2) & 0x3333333333333333ull) | ((x & 0x3333333333333333ull) << 2);
+        x = ((x >> 4) & 0x0f0f0f0f0f0f0f0full) | ((x & 0x0f0f0f0f0f0f0f0full) << 4);
+        x = __builtin_bswap64(x);
+        return Kmer(_size, x >> (64 - 2 * _size));
+    }
+    // The smaller of the k-mer and its reverse complement
+    Kmer canonical() const {
+        Kmer rc = reverseComplement();
+        return rc._bits < _bits ? rc : *this;
+    }
+
+    size_t hash() const {
+        // splitmix64 finalizer
+        Word x = _bits ^ ((Word)_size << 58);
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    bool operator==(const Kmer& k) const {
+        return _bits == k._bits && _size == k._size;
+    }
+    bool operator!=(const Kmer& k) const {
+        return !(*this == k);
+    }
+    bool operator<(const Kmer& k) const {
+        return _size != k._size ? _size < k._size : _bits < k._bits;
+    }
+
+    static Word mask(size_t k) {
+        return k < kMaxSize ? ((Word)1 << (2 * k)) - 1 : ~(Word)0;
+    }
+private:
+    Word _bits;
+    size_t _size;
+};
+
+namespace std {
+    template <>
+    struct hash<Kmer> {
+        size_t operator()(const Kmer& k) const {
+            return k.hash();
+        }
+    };
+}
+
+//
+// PackedSeq - A DNA sequence stored 2 bits per base. Bases other than ACGT
+// are masked and read back as 'N'. Any k-mer of up to 32 bases is taken from
+// at most two words.
+//
+class PackedSeq {
+public:
+    typedef Kmer::Word Word;
+
+    PackedSeq() : _size(0), _masked(0) {
+    }
+    explicit PackedSeq(const std::string& seq) : _size(0), _masked(0) {
+        assign(seq);
+    }
+
+    void assign(const std::string& seq) {
+        _size = seq.length();
+        _masked = 0;
+        _bits.assign(words(_size), 0);
+        _mask.assign((_size + 63) / 64, 0);
+        for (size_t i = 0; i < _size; ++i) {
+            set(i, seq[i]);
+        }
+    }
+
+    size_t length() const {
+        return _size;
+    }
+    char operator[](size_t i) const {
+        assert(i < _size);
+        return isMasked(i) ? 'N' : DNAAlphabet::DNA[code(i)];
+    }
+    void set(size_t i, char c) {
+        assert(i < _size);
+        int b = Kmer::code(c);
+        Word& m = _mask[i / 64];
+        Word bit = (Word)1 << (i % 64);
+        if (m & bit) {
+            --_masked;
+        }
+        if (b < 0) {
+            m |= bit;
+            ++_masked;
+            b = 0;
+        } else {
+            m &= ~bit;
+        }
+        size_t shift = 62 - 2 * (i % Kmer::kMaxSize);
+        Word& w = _bits[i / Kmer::kMaxSize];
+        w = (w & ~((Word)3 << shift)) | ((Word)b << shift);
+    }
+
+    // Returns true if any base in [i, i + n) is masked
+    bool masked(size_t i, size_t n) const {
+        assert(i + n <= _size);
+        if (_masked == 0 || n == 0) {
+            return false;
+        }
+        for (size_t j = i; j < i + n; j = (j / 64 + 1) * 64) {
+            size_t end = std::min(i + n, (j / 64 + 1) * 64);
+            Word bits = _mask[j / 64] >> (j % 64);
+            if (end - j < 64) {
+                bits &= ((Word)1 << (end - j)) - 1;
+            }
+            if (bits) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // The k bases from i, masked bases read as A
+    Kmer kmer(size_t i, size_t k) const {
+        assert(k <= Kmer::kMaxSize && i + k <= _size);
+        if (k == 0) {
+            return Kmer();
+        }
+        size_t w = i / Kmer::kMaxSize, o = 2 * (i % Kmer::kMaxSize);
+        Word bits = _bits[w] << o;
+        if (o > 0 && w + 1 < _bits.size()) {
+            bits |= _bits[w + 1] >> (64 - o);
+        }
+        return Kmer(k, bits >> (64 - 2 * k));
+    }
+
+    std::string str() const {
+        std::string s(_size, 0);
+        for (size_t i = 0; i < _size; ++i) {
+            s[i] = (*this)[i];
+        }
+        return s;
+    }
+private:
+    static size_t words(size_t n) {
+        return (n + Kmer::kMaxSize - 1) / Kmer::kMaxSize;
+    }
+    int code(size_t i) const {
+        return (_bits[i / Kmer::kMaxSize] >> (62 - 2 * (i % Kmer::kMaxSize))) & 3;
+    }
+    bool isMasked(size_t i) const {
+        return (_mask[i / 64] >> (i % 64)) & 1;
+    }
+
+    std::vector<Word> _bits;
+    std::vector<Word> _mask;
+    size_t _size;
+    size_t _masked;
+};
+
+#endif // kmer_h_
@@ -1,4 +1,5 @@
 #include "kmerdistr.h"
+#include "kmer.h"
 
 #include <string>
 
@@ -14,13 +15,23 @@ size_t KmerDistribution::sample(const FMIndex* index, size_t k, size_t n, KmerDi
             continue;
         }
 
+        // Count each kmer on both strands, the kmers of up to 32 bases are
+        // taken from the packed string
+        PackedSeq packed;
+        if (k <= Kmer::kMaxSize) {
+            packed.assign(s);
+        }
         for (size_t j = k; j < s.length(); ++j) {
-            std::string w = s.substr(j - k, k);
-            std::string v = make_dna_reverse_copy(w);
-
             size_t count = 0;
-            count += FMIndex::Interval::occurrences(w, index);
-            count += FMIndex::Interval::occurrences(v, index);
+            if (k <= Kmer::kMaxSize) {
+                Kmer w = packed.kmer(j - k, k);
+                count += FMIndex::Interval::occurrences(w, index);
+                count += FMIndex::Interval::occurrences(w.reverseComplement(), index);
+            } else {
+                std::string w = s.substr(j - k, k);
+                count += FMIndex::Interval::occurrences(w, index);
+                count += FMIndex::Interval::occurrences(make_dna_reverse_complement_copy(w), index);
+            }
 
             if (distr != NULL) {
                 distr->add(count);
@@ -1,48 +1,185 @@
 #include "kseq.h"
+#include "constant.h"
 #include "utils.h"
 
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <fstream>
-#include <map>
 #include <memory>
 #include <numeric>
 #include <unordered_map>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/format.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/stream.hpp>
 
 #include <log4cxx/logger.h>
 
 static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("arcs.DNASeq"));
 
-char make_dna_complement(char c) {
-    static std::map<char, char> mapping = {
-        {'A', 'T'},
-        {'C', 'G'},
-        {'G', 'C'},
-        {'T', 'A'},
-        {'N', 'N'},
-        };
-    return mapping[c];
+// ACGTN and acgtn map to their complements, anything else to itself
+const unsigned char kDNAComplement[256] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+    16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
+    32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47,
+    48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63,
+    64, 'T', 66, 'G', 68, 69, 70, 'C', 72, 73, 74, 75, 76, 77, 'N', 79,
+    80, 81, 82, 83, 'A', 85, 86, 87, 88, 89, 90, 91, 92, 93, 94, 95,
+    96, 't', 98, 'g', 100, 101, 102, 'c', 104, 105, 106, 107, 108, 109, 'n', 111,
+    112, 113, 114, 115, 'a', 117, 118, 119, 120, 121, 122, 123, 124, 125, 126, 127,
+    128, 129, 130, 131, 132, 133, 134, 135, 136, 137, 138, 139, 140, 141, 142, 143,
+    144, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155, 156, 157, 158, 159,
+    160, 161, 162, 163, 164, 165, 166, 167, 168, 169, 170, 171, 172, 173, 174, 175,
+    176, 177, 178, 179, 180, 181, 182, 183, 184, 185, 186, 187, 188, 189, 190, 191,
+    192, 193, 194, 195, 196, 197, 198, 199, 200, 201, 202, 203, 204, 205, 206, 207,
+    208, 209, 210, 211, 212, 213, 214, 215, 216, 217, 218, 219, 220, 221, 222, 223,
+    224, 225, 226, 227, 228, 229, 230, 231, 232, 233, 234, 235, 236, 237, 238, 239,
+    240, 241, 242, 243, 244, 245, 246, 247, 248, 249, 250, 251, 252, 253, 254, 255,
+};
+
+//
+// The transforms below work on [i, j) of src, writing the reverse complement
+// of src[i] to dst[j - 1] and so on, so that dst may be src itself. The x86
+// versions complement 16 or 32 bases at once with pshufb and are picked at
+// run time from the CPU features.
+//
+typedef void (*DNATransform)(const char* src, char* dst, size_t i, size_t j);
+
+static void dna_complement_scalar(const char* src, char* dst, size_t i, size_t j) {
+    for (; i < j; ++i) {
+        dst[i] = make_dna_complement(src[i]);
+    }
 }
 
-void make_dna_complement(std::string& sequence) {
-    static std::map<char, char> mapping = {
-        {'A', 'T'},
-        {'C', 'G'},
-        {'G', 'C'},
-        {'T', 'A'},
-        {'N', 'N'},
-        };
+static void dna_reverse_complement_scalar(const char* src, char* dst, size_t i, size_t j) {
+    for (; i + 1 < j; ++i, --j) {
+        char a = src[i], b = src[j - 1];
+        dst[i] = make_dna_complement(b);
+        dst[j - 1] = make_dna_complement(a);
+    }
+    if (i + 1 == j) {
+        dst[i] = make_dna_complement(src[i]);
+    }
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+
+// The bases differ in their low nibble (A=0x41, C=0x43, G=0x47, N=0x4e,
+// T=0x54) and bit 0x20 makes them lowercase, so a shuffle on the nibble finds
+// the complement. A byte is a base if the same shuffle on the bases gives it
+// back, other bytes are kept.
+#define DNA_NIBBLE_BASES 0, 'A', 0, 'C', 'T', 0, 0, 'G', 0, 0, 0, 0, 0, 0, 'N', 0
+#define DNA_NIBBLE_COMPLEMENTS 0, 'T', 0, 'G', 'A', 0, 0, 'C', 0, 0, 0, 0, 0, 0, 'N', 0
+#define DNA_REVERSE_BYTES 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0
+
+__attribute__((target("ssse3")))
+static inline __m128i dna_complement_16(__m128i x) {
+    const __m128i bases = _mm_setr_epi8(DNA_NIBBLE_BASES);
+    const __m128i complements = _mm_setr_epi8(DNA_NIBBLE_COMPLEMENTS);
+    __m128i nibble = _mm_and_si128(x, _mm_set1_epi8(0x0f));
+    __m128i lower = _mm_and_si128(x, _mm_set1_epi8(0x20));
+    __m128i base = _mm_cmpeq_epi8(_mm_or_si128(_mm_shuffle_epi8(bases, nibble), lower), x);
+    __m128i y = _mm_or_si128(_mm_shuffle_epi8(complements, nibble), lower);
+    return _mm_or_si128(_mm_and_si128(base, y), _mm_andnot_si128(base, x));
+}
+
+__attribute__((target("ssse3")))
+static inline __m128i dna_reverse_complement_16(__m128i x) {
+    return _mm_shuffle_epi8(dna_complement_16(x), _mm_setr_epi8(DNA_REVERSE_BYTES));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i dna_complement_32(__m256i x) {
+    const __m256i bases = _mm256_setr_epi8(DNA_NIBBLE_BASES, DNA_NIBBLE_BASES);
+    const __m256i complements = _mm256_setr_epi8(DNA_NIBBLE_COMPLEMENTS, DNA_NIBBLE_COMPLEMENTS);
+    __m256i nibble = _mm256_and_si256(x, _mm256_set1_epi8(0x0f));
+    __m256i lower = _mm256_and_si256(x, _mm256_set1_epi8(0x20));
+    __m256i base = _mm256_cmpeq_epi8(_mm256_or_si256(_mm256_shuffle_epi8(bases, nibble), lower), x);
+    __m256i y = _mm256_or_si256(_mm256_shuffle_epi8(complements, nibble), lower);
+    return _mm256_blendv_epi8(x, y, base);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i dna_reverse_complement_32(__m256i x) {
+    // The shuffle stays within the 128 bit lanes, swap them afterwards
+    x = _mm256_shuffle_epi8(dna_complement_32(x), _mm256_setr_epi8(DNA_REVERSE_BYTES, DNA_REVERSE_BYTES));
+    return _mm256_permute4x64_epi64(x, 0x4e);
+}
+
+__attribute__((target("ssse3")))
+static void dna_complement_ssse3(const char* src, char* dst, size_t i, size_t j) {
+    for (; i + 16 <= j; i += 16) {
+        _mm_storeu_si128((__m128i*)(dst + i), dna_complement_16(_mm_loadu_si128((const __m128i*)(src + i))));
+    }
+    dna_complement_scalar(src, dst, i, j);
+}
+
+__attribute__((target("ssse3")))
+static void dna_reverse_complement_ssse3(const char* src, char* dst, size_t i, size_t j) {
+    // Both ends are loaded before either is stored
+    for (; i + 32 <= j; i += 16, j -= 16) {
+        __m128i front = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i back = _mm_loadu_si128((const __m128i*)(src + j - 16));
+        _mm_storeu_si128((__m128i*)(dst + i), dna_reverse_complement_16(back));
+        _mm_storeu_si128((__m128i*)(dst + j - 16), dna_reverse_complement_16(front));
+    }
+    dna_reverse_complement_scalar(src, dst, i, j);
+}
+
+__attribute__((target("avx2")))
+static void dna_complement_avx2(const char* src, char* dst, size_t i, size_t j) {
+    for (; i + 32 <= j; i += 32) {
+        _mm256_storeu_si256((__m256i*)(dst + i), dna_complement_32(_mm256_loadu_si256((const __m256i*)(src + i))));
+    }
+    dna_complement_ssse3(src, dst, i, j);
+}
+
+__attribute__((target("avx2")))
+static void dna_reverse_complement_avx2(const char* src, char* dst, size_t i, size_t j) {
+    for (; i + 64 <= j; i += 32, j -= 32) {
+        __m256i front = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i back = _mm256_loadu_si256((const __m256i*)(src + j - 32));
+        _mm256_storeu_si256((__m256i*)(dst + i), dna_reverse_complement_32(back));
+        _mm256_storeu_si256((__m256i*)(dst + j - 32), dna_reverse_complement_32(front));
+    }
+    dna_reverse_complement_ssse3(src, dst, i, j);
+}
 
-    size_t N = sequence.length();
-    for (size_t i = 0; i < N; ++i) {
-        sequence[i] = mapping[sequence[i]];
+static DNATransform dna_transform(DNATransform avx2, DNATransform ssse3, DNATransform scalar) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return avx2;
+    } else if (__builtin_cpu_supports("ssse3")) {
+        return ssse3;
     }
+    return scalar;
+}
+#define DNA_TRANSFORM(name) dna_transform(name##_avx2, name##_ssse3, name##_scalar)
+#else
+#define DNA_TRANSFORM(name) name##_scalar
+#endif
+
+void make_dna_complement(const char* src, size_t n, char* dst) {
+    static const DNATransform transform = DNA_TRANSFORM(dna_complement);
+    transform(src, dst, 0, n);
+}
+
+void make_dna_reverse_complement(const char* src, size_t n, char* dst) {
+    static const DNATransform transform = DNA_TRANSFORM(dna_reverse_complement);
+    transform(src, dst, 0, n);
+}
+
+void make_dna_complement(std::string& sequence) {
+    make_dna_complement(sequence.data(), sequence.length(), &sequence[0]);
 }
 
 std::string make_dna_complement_copy(const std::string& sequence) {
-    std::string complement = sequence;
-    make_dna_complement(complement);
+    std::string complement(sequence.length(), 0);
+    make_dna_complement(sequence.data(), sequence.length(), &complement[0]);
     return complement;
 }
 
@@ -51,26 +188,28 @@ void make_dna_reverse(std::string& sequence) {
 }
 
 std::string make_dna_reverse_copy(const std::string& sequence) {
-    std::string reverse = sequence;
-    make_dna_reverse(reverse);
-    return reverse;
+    return std::string(sequence.rbegin(), sequence.rend());
 }
 
 void make_dna_reverse_complement(std::string& sequence) {
-    make_dna_complement(sequence);
-    make_dna_reverse(sequence);
+    make_dna_reverse_complement(sequence.data(), sequence.length(), &sequence[0]);
 }
 
 std::string make_dna_reverse_complement_copy(const std::string& sequence) {
-    std::string complement = make_dna_complement_copy(sequence);
-    make_dna_reverse(complement);
+    std::string complement;
+    make_dna_reverse_complement_copy(sequence, complement);
     return complement;
 }
 
+void make_dna_reverse_complement_copy(const std::string& sequence, std::string& complement) {
+    complement.resize(sequence.length());
+    make_dna_reverse_complement(sequence.data(), sequence.length(), &complement[0]);
+}
+
 void make_seq_name(std::string& name, std::string& comment) {
     size_t i = name.find_first_of(" \t");
     if (i != std::string::npos) {
-        comment = name.substr(i + 1);
+        comment.assign(name, i + 1, std::string::npos);
         name.resize(i);
     } else {
         comment.clear();
@@ -97,8 +236,10 @@ void DNASeq::make_reverse() {
 }
 
 void DNASeq::make_reverse_complement() {
-    make_complement();
-    make_reverse();
+    make_dna_reverse_complement(seq);
+    if (!quality.empty()) {
+        std::reverse(quality.begin(), quality.end());
+    }
 }
 
 std::ostream& operator << (std::ostream& os, const DNASeq& seq) {
@@ -134,6 +275,65 @@ DNASeqReader* DNASeqReaderFactory::create(std::istream& stream) {
     return NULL;
 }
 
+DNASeqReader* DNASeqReaderFactory::create(const std::string& file, size_t threads) {
+    if (ParallelDNASeqReader::splittable(file)) {
+        std::ifstream stream(file);
+        int c = stream.peek();
+        if (c == '@' || c == '>') {
+            return new ParallelDNASeqReader(file, threads);
+        }
+    }
+    return NULL;
+}
+
+bool DNASeqReader::getline(const char*& line, size_t& length) {
+    while (true) {
+        const char* begin = _buffer.data() + _head;
+        const char* end = static_cast<const char *>(memchr(begin, '\n', _tail - _head));
+        if (end != NULL) {
+            line = begin;
+            length = end - begin;
+            _head += length + 1;
+            return true;
+        }
+        if (_eof) {
+            // The last line has no newline
+            if (_head < _tail) {
+                line = begin;
+                length = _tail - _head;
+                _head = _tail;
+                return true;
+            }
+            return false;
+        }
+
+        // Move the partial line to the front and fill the rest of the buffer,
+        // grow it if the line does not fit.
+        std::copy(_buffer.begin() + _head, _buffer.begin() + _tail, _buffer.begin());
+        _tail -= _head;
+        _head = 0;
+        if (_tail == _buffer.size()) {
+            _buffer.resize(std::max(kBufferSize, 2 * _buffer.size()));
+        }
+        _stream.read(_buffer.data() + _tail, _buffer.size() - _tail);
+        _tail += _stream.gcount();
+        if (!_stream) {
+            _eof = true;
+        }
+    }
+}
+
+// Same as boost::algorithm::trim on a line in the buffer
+static void trim(const char*& line, size_t& length) {
+    while (length > 0 && isspace(line[length - 1])) {
+        --length;
+    }
+    while (length > 0 && isspace(line[0])) {
+        ++line;
+        --length;
+    }
+}
+
 bool FASTQReader::read(DNASeq& sequence) {
     enum {
         kName, 
@@ -142,87 +342,289 @@ bool FASTQReader::read(DNASeq& sequence) {
         kQuality, 
     };
 
-    if (_stream) {
-        int state = kName;
-        std::string buf;
-
-        while (std::getline(_stream, buf)) {
-            boost::algorithm::trim(buf);
-            if (buf.empty()) continue;
-            if (state == kName) {
-                if (boost::algorithm::starts_with(buf, "@")) {
-                    sequence.name = buf.substr(1);
-                    state = kSequence;
-                } else {
-                    LOG4CXX_WARN(logger, boost::format("fastq=>invalid line for sequence name: %s") % buf);
-                    return false;
-                }
-            } else if (state == kSequence) {
-                sequence.seq = buf;
-                state = kName2;
-            } else if (state == kName2) {
-                if (boost::algorithm::starts_with(buf, "+") && (buf.length() == 1 || boost::algorithm::ends_with(buf, sequence.name))) {
-                    state = kQuality;
-                } else {
-                    LOG4CXX_WARN(logger, boost::format("fastq=>names aren't equal: %s") % buf);
-                    return false;
-                }
-            } else if (state == kQuality) {
-                if (buf.length() == sequence.seq.length()) {
-                    sequence.quality = buf;
-                    // name
-                    make_seq_name(sequence.name, sequence.comment);
-                    return true;
-                } else {
-                    LOG4CXX_WARN(logger, boost::format("fastq=>length of sequence and quality are not equal: %s") % buf);
-                    return false;
-                }
+    // The fields of sequence are assigned in place, so reading into a recycled
+    // sequence does not allocate once warmed up.
+    int state = kName;
+
+    const char* line;
+    size_t length;
+    while (getline(line, length)) {
+        trim(line, length);
+        if (length == 0) continue;
+        if (state == kName) {
+            if (line[0] == '@') {
+                sequence.name.assign(line + 1, length - 1);
+                state = kSequence;
+            } else {
+                LOG4CXX_WARN(logger, boost::format("fastq=>invalid line for sequence name: %s") % std::string(line, length));
+                _failed = true;
+                return false;
+            }
+        } else if (state == kSequence) {
+            sequence.seq.assign(line, length);
+            state = kName2;
+        } else if (state == kName2) {
+            const std::string& name = sequence.name;
+            if (line[0] == '+' && (length == 1 || (length >= name.length() && std::equal(name.begin(), name.end(), line + length - name.length())))) {
+                state = kQuality;
+            } else {
+                LOG4CXX_WARN(logger, boost::format("fastq=>names aren't equal: %s") % std::string(line, length));
+                _failed = true;
+                return false;
+            }
+        } else if (state == kQuality) {
+            if (length == sequence.seq.length()) {
+                sequence.quality.assign(line, length);
+                // name
+                make_seq_name(sequence.name, sequence.comment);
+                return true;
+            } else {
+                LOG4CXX_WARN(logger, boost::format("fastq=>length of sequence and quality are not equal: %s") % std::string(line, length));
+                _failed = true;
+                return false;
             }
         }
     }
 
+    // A truncated record
+    if (state != kName) {
+        _failed = true;
+    }
     return false;
 }
 
 bool FASTAReader::read(DNASeq& sequence) {
-    if (_stream) {
-        std::string seq;
-
-        std::string line;
-        while (std::getline(_stream, line)) {
-            boost::algorithm::trim(line);
-            if (line.empty()) continue;
-            if (boost::algorithm::starts_with(line, ">")) {
-                if (!seq.empty() && !_name.empty()) {
-                    // name
-                    sequence.name = _name;
-                    make_seq_name(sequence.name, sequence.comment);
-                    sequence.seq = seq;
-                    _name = line.substr(1);
-                    return true;
-                } else if (!_name.empty()) {
-                    LOG4CXX_WARN(logger, boost::format("fastq=>invalid line for sequence name: %s") % line);
-                    return false;
-                }
-                _name = line.substr(1);
-            } else {
-                seq += line;
+    // The sequence lines are appended to sequence.seq in place, see FASTQReader::read
+    std::string& seq = sequence.seq;
+    seq.clear();
+
+    const char* line;
+    size_t length;
+    while (getline(line, length)) {
+        trim(line, length);
+        if (length == 0) continue;
+        if (line[0] == '>') {
+            if (!seq.empty() && !_name.empty()) {
+                // name
+                sequence.name = _name;
+                make_seq_name(sequence.name, sequence.comment);
+                _name.assign(line + 1, length - 1);
+                return true;
+            } else if (!_name.empty()) {
+                LOG4CXX_WARN(logger, boost::format("fastq=>invalid line for sequence name: %s") % std::string(line, length));
+                _failed = true;
+                return false;
             }
+            _name.assign(line + 1, length - 1);
+        } else {
+            seq.append(line, length);
         }
+    }
 
-        // the last one
-        if (!seq.empty() && !_name.empty()) {
-            // name
-            sequence.name = _name;
-            make_seq_name(sequence.name, sequence.comment);
-            sequence.seq = seq;
-            return true;
+    // the last one
+    if (!seq.empty() && !_name.empty()) {
+        // name
+        sequence.name = _name;
+        make_seq_name(sequence.name, sequence.comment);
+        return true;
+    }
+
+    return false;
+}
+
+//
+// ParallelDNASeqReader
+//
+ParallelDNASeqReader::ParallelDNASeqReader(const std::string& file, size_t threads, size_t chunk) : DNASeqReader(_file), _filename(file), _file(file, std::ios::binary), _chunk(chunk), _slots(2 * std::max(threads, (size_t)1)), _threads(std::max(threads, (size_t)1)) {
+    _fastq = (_file.peek() == '@');
+    _size = _file ? boost::filesystem::file_size(file) : 0;
+    _chunks = (_size + _chunk - 1) / _chunk;
+    start();
+}
+
+ParallelDNASeqReader::~ParallelDNASeqReader() {
+    stop();
+}
+
+bool ParallelDNASeqReader::splittable(const std::string& file) {
+    if (boost::algorithm::ends_with(file, GZIP_EXT) || boost::algorithm::ends_with(file, BZIP_EXT)) {
+        return false;
+    }
+    boost::system::error_code ec;
+    return boost::filesystem::is_regular_file(file, ec);
+}
+
+void ParallelDNASeqReader::reset() {
+    stop();
+    start();
+}
+
+void ParallelDNASeqReader::start() {
+    _failed = false;
+    _next = _current = _index = 0;
+    _acquired = false;
+    _stop = false;
+    for (auto& slot : _slots) {
+        slot.count = 0;
+        slot.ready = slot.failed = false;
+    }
+    for (auto& thread : _threads) {
+        thread = std::thread(&ParallelDNASeqReader::parse, this);
+    }
+}
+
+void ParallelDNASeqReader::stop() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+        _vacant.notify_all();
+    }
+    for (auto& thread : _threads) {
+        if (thread.joinable()) {
+            thread.join();
         }
     }
+}
+
+bool ParallelDNASeqReader::read(DNASeq& sequence) {
+    // The records of the current chunk are handed out without locking, the
+    // lock is only taken to move from one chunk to the next.
+    while (!_failed && _current < _chunks) {
+        Chunk& chunk = _slots[_current % _slots.size()];
+        if (!_acquired) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _ready.wait(lock, [&chunk] { return chunk.ready; });
+            _acquired = true;
+        }
+        if (_index < chunk.count) {
+            // The buffers of sequence are recycled by the parser
+            sequence.swap(chunk.records[_index++]);
+            return true;
+        }
+        if (chunk.failed) {
+            _failed = true;
+            break;
+        }
 
+        std::lock_guard<std::mutex> lock(_mutex);
+        chunk.ready = false;
+        ++_current;
+        _index = 0;
+        _acquired = false;
+        _vacant.notify_all();
+    }
     return false;
 }
 
+void ParallelDNASeqReader::parse() {
+    std::ifstream file(_filename, std::ios::binary);
+    std::string buffer;
+
+    while (true) {
+        size_t k;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _vacant.wait(lock, [this] { return _stop || _next >= _chunks || _next < _current + _slots.size(); });
+            if (_stop || _next >= _chunks) {
+                break;
+            }
+            k = _next++;
+        }
+        Chunk& chunk = _slots[k % _slots.size()];
+
+        size_t begin = boundary(file, k * _chunk), end = boundary(file, (k + 1) * _chunk);
+        buffer.resize(end - begin);
+        file.clear();
+        file.seekg(begin);
+        file.read(&buffer[0], buffer.size());
+
+        boost::iostreams::stream<boost::iostreams::array_source> stream(buffer.data(), file.gcount());
+        std::unique_ptr<DNASeqReader> reader;
+        if (_fastq) {
+            reader.reset(new FASTQReader(stream));
+        } else {
+            reader.reset(new FASTAReader(stream));
+        }
+        chunk.count = 0;
+        while (true) {
+            if (chunk.count == chunk.records.size()) {
+                chunk.records.resize(chunk.count + 1);
+            }
+            if (!reader->read(chunk.records[chunk.count])) {
+                break;
+            }
+            ++chunk.count;
+        }
+        chunk.failed = reader->failed() || (size_t)file.gcount() != buffer.size();
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        chunk.ready = true;
+        _ready.notify_all();
+    }
+}
+
+size_t ParallelDNASeqReader::boundary(std::istream& stream, size_t offset) const {
+    if (offset == 0 || offset >= _size) {
+        return std::min(offset, _size);
+    }
+
+    // Scan a window starting at the character before offset, so the lines
+    // starting at offset are found too. Grow it until a cut is found.
+    std::string window;
+    for (size_t length = 1 << 16; ; length *= 2) {
+        size_t start = offset - 1;
+        window.resize(std::min(length, _size - start));
+        stream.clear();
+        stream.seekg(start);
+        stream.read(&window[0], window.size());
+        window.resize(stream.gcount());
+        bool last = (start + window.size() >= _size);
+
+        // The first non-space character of every line from offset, 0 for blank
+        // lines, and where the line starts
+        std::vector<std::pair<char, size_t> > lines;
+        for (size_t i = window.find('\n'); i != std::string::npos && i + 1 < window.size(); i = window.find('\n', i + 1)) {
+            size_t j = i + 1;
+            while (j < window.size() && window[j] != '\n' && isspace(window[j])) {
+                ++j;
+            }
+            lines.push_back(std::make_pair(j < window.size() && window[j] != '\n' ? window[j] : 0, i + 1));
+        }
+
+        if (!last && !lines.empty()) {
+            // The last line may go on after the window
+            lines.pop_back();
+        }
+
+        // A FASTA name followed by a sequence, or a FASTQ name followed by a
+        // sequence and a '+'
+        char mark = _fastq ? '@' : '>';
+        size_t distance = _fastq ? 2 : 1;
+        bool grow = false;
+        for (size_t i = 0; i < lines.size() && !grow; ++i) {
+            if (lines[i].first != mark) {
+                continue;
+            }
+            size_t j = i + 1, n = 0;
+            for (; j < lines.size(); ++j) {
+                if (lines[j].first != 0 && ++n == distance) {
+                    break;
+                }
+            }
+            if (j < lines.size()) {
+                if (_fastq ? lines[j].first == '+' : lines[j].first != '>') {
+                    return start + lines[i].second;
+                }
+            } else if (!last) {
+                grow = true;
+            }
+        }
+        if (last) {
+            return _size;
+        }
+    }
+}
+
 bool ReadDNASequences(std::istream& stream, DNASeqList& sequences) {
     std::shared_ptr<DNASeqReader> reader(DNASeqReaderFactory::create(stream));
     if (!reader) {
@@ -251,3 +653,29 @@ bool ReadDNASequences(const std::vector<std::string>& filelist, DNASeqList& sequ
     }
     return true;
 }
+
+bool ReadDNASequences(const std::string& file, DNASeqList& sequences, size_t threads) {
+    std::shared_ptr<DNASeqReader> reader;
+    if (threads > 1) {
+        reader.reset(DNASeqReaderFactory::create(file, threads));
+    }
+    if (!reader) {
+        return ReadDNASequences(file, sequences);
+    }
+    // Read in place, the records are swapped out of the reader
+    sequences.emplace_back();
+    while (reader->read(sequences.back())) {
+        sequences.emplace_back();
+    }
+    sequences.pop_back();
+    return true;
+}
+
+bool ReadDNASequences(const std::vector<std::string>& filelist, DNASeqList& sequences, size_t threads) {
+    for (const auto& file : filelist) {
+        if (!ReadDNASequences(file, sequences, threads)) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -1,20 +1,40 @@
 #ifndef kseq_h_
 #define kseq_h_
 
+#include <condition_variable>
+#include <fstream>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "quality.h"
 
-char make_dna_complement(char c);
+//
+// DNA transforms. The complement keeps the case of the bases and leaves any
+// character other than ACGTN unchanged.
+//
+extern const unsigned char kDNAComplement[256];
+
+inline char make_dna_complement(char c) {
+    return kDNAComplement[(unsigned char)c];
+}
+
+// Transform n bases of src into dst, which may be src itself but must not
+// otherwise overlap it
+void make_dna_complement(const char* src, size_t n, char* dst);
+void make_dna_reverse_complement(const char* src, size_t n, char* dst);
+
 void make_dna_complement(std::string& dna);
 std::string make_dna_complement_copy(const std::string& dna);
 void make_dna_reverse(std::string& dna);
 std::string make_dna_reverse_copy(const std::string& dna);
 void make_dna_reverse_complement(std::string& dna);
 std::string make_dna_reverse_complement_copy(const std::string& dna);
+// Reuses the capacity of rc
+void make_dna_reverse_complement_copy(const std::string& dna, std::string& rc);
 
 //
 // DNASeq represents a DNA sequence.
@@ -25,6 +45,19 @@ public:
     DNASeq(const std::string& name, const std::string& seq);
     DNASeq(const std::string& name, const std::string& seq, const std::string& quality);
     virtual ~DNASeq() {}
+    // The virtual destructor hides the implicit moves
+    DNASeq(const DNASeq&) = default;
+    DNASeq(DNASeq&&) = default;
+    DNASeq& operator=(const DNASeq&) = default;
+    DNASeq& operator=(DNASeq&&) = default;
+
+    // Exchange the strings, their buffers included
+    void swap(DNASeq& other) {
+        name.swap(other.name);
+        seq.swap(other.seq);
+        quality.swap(other.quality);
+        comment.swap(other.comment);
+    }
 
     std::string name;
     std::string seq;
@@ -51,21 +84,37 @@ typedef std::vector<DNASeq> DNASeqList;
 bool ReadDNASequences(std::istream& stream, DNASeqList& sequences);
 bool ReadDNASequences(const std::string& file, DNASeqList& sequences);
 bool ReadDNASequences(const std::vector<std::string>& filelist, DNASeqList& sequences);
+// Parse the files on threads when they can be split, see ParallelDNASeqReader
+bool ReadDNASequences(const std::string& file, DNASeqList& sequences, size_t threads);
+bool ReadDNASequences(const std::vector<std::string>& filelist, DNASeqList& sequences, size_t threads);
 
+//
+// DNASeqReader - Base of the sequence readers. The stream is consumed in large
+// blocks and the lines are handed out as pointers into the block, so parsing
+// neither goes through std::getline nor allocates per line.
+//
 class DNASeqReader {
 public:
-    DNASeqReader(std::istream& stream) : _stream(stream) {
+    DNASeqReader(std::istream& stream) : _stream(stream), _failed(false), _head(0), _tail(0), _eof(false) {
         _pos = 0;//_stream.tellg();
     }
     virtual ~DNASeqReader() {
     }
 
     virtual void reset() {
+        _failed = false;
+        _head = _tail = 0;
+        _eof = false;
         _stream.clear();
         _stream.seekg(_pos);
     }
     virtual bool read(DNASeq& sequence) = 0;
 
+    // Whether the last read stopped at a malformed record rather than at the end
+    bool failed() const {
+        return _failed;
+    }
+
     bool hasAttr(const std::string& key) const {
         return _attrs.find(key) != _attrs.end();
     }
@@ -80,14 +129,29 @@ public:
         _attrs[key] = val;
     }
 protected:
+    // Get the next line without the newline. It points into the buffer and
+    // stays valid until the next call. Returns false at the end of the stream.
+    bool getline(const char*& line, size_t& length);
+
     std::istream& _stream;
     size_t _pos;
     std::map<std::string, std::string> _attrs;
+    bool _failed;
+private:
+    static const size_t kBufferSize = 1 << 20;
+
+    // The unread lines are buffer[_head, _tail)
+    std::vector<char> _buffer;
+    size_t _head;
+    size_t _tail;
+    bool _eof;
 };
 
 class DNASeqReaderFactory {
 public:
     static DNASeqReader* create(std::istream& stream);
+    // A ParallelDNASeqReader, or NULL if file can not be split
+    static DNASeqReader* create(const std::string& file, size_t threads);
 };
 
 //
@@ -142,4 +206,63 @@ private:
     std::string _name;
 };
 
+//
+// ParallelDNASeqReader - Reads a large uncompressed FASTQ/FASTA file on several
+// threads. The file is cut into chunks of bytes, the cuts are moved forward to
+// the next record, every chunk is parsed on its own thread and the records are
+// handed out in the original order.
+//
+// A cut is on a FASTA line starting with '>', or on a FASTQ line starting with
+// '@' whose next but one line starts with '+'. A quality line can start with
+// '@' too, but it is followed by a name and a sequence.
+//
+class ParallelDNASeqReader : public DNASeqReader {
+public:
+    ParallelDNASeqReader(const std::string& file, size_t threads, size_t chunk=kChunkSize);
+    ~ParallelDNASeqReader();
+
+    // Whether file is a plain file, compressed files and pipes can not be split
+    static bool splittable(const std::string& file);
+
+    void reset();
+    bool read(DNASeq& sequence);
+private:
+    static const size_t kChunkSize = 8 << 20;
+
+    struct Chunk {
+        Chunk() : count(0), ready(false), failed(false) {
+        }
+        // records[0, count) are valid, the others are kept for their buffers
+        DNASeqList records;
+        size_t count;
+        bool ready;
+        bool failed;
+    };
+
+    void start();
+    void stop();
+    void parse();
+    // The first record at or after offset
+    size_t boundary(std::istream& stream, size_t offset) const;
+
+    std::string _filename;
+    std::ifstream _file;
+    bool _fastq;
+    size_t _size;
+    size_t _chunk;
+    size_t _chunks;
+
+    // Chunk k is parsed into _slots[k % _slots.size()]
+    std::vector<Chunk> _slots;
+    std::vector<std::thread> _threads;
+    size_t _next;
+    size_t _current;
+    size_t _index;
+    bool _acquired;
+    bool _stop;
+    std::mutex _mutex;
+    std::condition_variable _ready;
+    std::condition_variable _vacant;
+};
+
 #endif // kseq_h_
@@ -8,6 +8,7 @@
 #include <log4cxx/basicconfigurator.h>
 #include <log4cxx/propertyconfigurator.h>
 
+#include "bgzf.h"
 #include "constant.h"
 #include "runner.h"
 
@@ -74,6 +75,11 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    // The gzip files are compressed with as many threads as the command uses
+    if (options.find("threads") != options.not_found()) {
+        BGZFSink::threads(options.get<size_t>("threads", 1));
+    }
+
     Arguments arguments;
     std::copy(argv + optind + 1, argv + argc, std::back_inserter(arguments));
 
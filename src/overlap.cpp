@@ -4,6 +4,8 @@
 #include "fmindex.h"
 #include "overlap_builder.h"
 #include "runner.h"
+#include "utils.h"
+#include "worker_stats.h"
 
 #include <iostream>
 #include <memory>
@@ -12,6 +14,7 @@
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
 
 #include <log4cxx/logger.h>
 
@@ -34,12 +37,41 @@ public:
         if (options.find("prefix") != options.not_found()) {
             output = options.get<std::string>("prefix");
         }
-        LOG4CXX_INFO(logger, boost::format("output: %s%s%s") % output % ASQG_EXT % GZIP_EXT);
+
+        // Process only the i-th of N shards of the reads
+        size_t shard = 0, shards = 1;
+        if (options.find("shard") != options.not_found()) {
+            std::string spec = options.get<std::string>("shard");
+            std::vector<std::string> tokens;
+            boost::algorithm::split(tokens, spec, boost::is_any_of("/"));
+            try {
+                if (tokens.size() != 2 || (shard = boost::lexical_cast<size_t>(tokens[0])) < 1 || (shards = boost::lexical_cast<size_t>(tokens[1])) < shard) {
+                    throw boost::bad_lexical_cast();
+                }
+                --shard;
+            } catch (const boost::bad_lexical_cast& e) {
+                LOG4CXX_ERROR(logger, boost::format("Invalid shard %s, expected i/N with 1 <= i <= N") % spec);
+                return -1;
+            }
+        }
+        if (options.find("intermediate-codec") != options.not_found()) {
+            std::string codec = options.get<std::string>("intermediate-codec");
+            if (!Utils::intermediateCodec(codec)) {
+                LOG4CXX_ERROR(logger, boost::format("Unsupported codec %s for the intermediate files, expected one of %s") % codec % Utils::intermediateCodecs());
+                return -1;
+            }
+        }
+
+        std::string asqg = OverlapBuilder::shardPrefix(output, shard, shards) + ASQG_EXT + GZIP_EXT;
+        LOG4CXX_INFO(logger, boost::format("output: %s") % asqg);
+
+        WorkerStats::sampleInterval(options.get<double>("stats-interval", 0));
 
         FMIndex fmi, rfmi;
         if (FMIndex::load(output + BWT_EXT, fmi) && FMIndex::load(output + RBWT_EXT, rfmi)) {
-            OverlapBuilder builder(&fmi, &rfmi, output, options.find("exhaustive") == options.not_found(), options.find("no-opposite-strand") == options.not_found());
-            if (!builder.build(input, options.get<size_t>("min-overlap", 10), output + ASQG_EXT + GZIP_EXT, options.get<size_t>("threads", 1), options.get<size_t>("batch-size", 1000))) {
+            OverlapBuilder::Limits limits(options.get<size_t>("max-overlap-blocks", 0), options.get<size_t>("max-interval-size", 0), options.get<size_t>("max-extensions", 0));
+            OverlapBuilder builder(&fmi, &rfmi, output, options.find("exhaustive") == options.not_found(), options.find("no-opposite-strand") == options.not_found(), limits);
+            if (!builder.build(input, options.get<size_t>("min-overlap", 10), asqg, options.get<size_t>("threads", 1), options.get<size_t>("batch-size", 1000), shard, shards)) {
                 LOG4CXX_ERROR(logger, boost::format("Failed to build overlaps from reads %s") % input);
                 r = -1;
             }
@@ -48,6 +80,14 @@ public:
             r = -1;
         }
 
+        if (r == 0 && options.find("stats") != options.not_found()) {
+            std::string statsfile = options.get<std::string>("stats");
+            if (!WorkerStats::write(statsfile)) {
+                LOG4CXX_ERROR(logger, boost::format("Failed to write stats to %s") % statsfile);
+                r = -1;
+            }
+        }
+
         return r;
     }
 
@@ -69,13 +109,24 @@ private:
                 "      -h, --help                       display this help and exit\n"
                 "\n"
                 "      -t, --threads=NUM                use NUM threads to construct the index (default: 1)\n"
-                "          --batch-size=NUM             use NUM batches for each thread (default: 1000)\n"
+                "          --batch-size=NUM             process at most NUM reads at once in each thread, the size adapts to the cost of\n"
+                "                                       the reads below NUM (default: 1000)\n"
                 "      -m, --min-overlap=LEN            minimum overlap required between two reads (default: 45)\n"
                 "      -p, --prefix=PREFIX              write index to file using PREFIX instead of prefix of READSFILE\n"
                 "      -x, --exhaustive                 output all overlaps, including transitive edges\n"
                 "          --no-opposite-strand         treat all reads as forward strand\n"
+                "          --max-overlap-blocks=NUM     give up on reads with more than NUM overlap blocks (default: 0, no limit)\n"
+                "          --max-interval-size=NUM      give up on reads overlapping more than NUM reads in one block (default: 0, no limit)\n"
+                "          --max-extensions=NUM         give up on reads needing more than NUM steps to remove transitive overlaps (default: 0, no limit)\n"
+                "                                       the reads given up on are tagged AB:i:1 and have no edges at all\n"
+                "          --shard=I/N                  only compute the overlaps of the I-th of N equal ranges of the reads,\n"
+                "                                       the outputs of all the shards are combined with overlap-merge\n"
+                "                                       (identical to an unsharded run if both use a single thread)\n"
+                "          --intermediate-codec=NAME    compress the intermediate files with NAME, one of %s (default: %s)\n"
+                "          --stats=FILE                 write the throughput and latency counters of the workers to FILE as JSON\n"
+                "          --stats-interval=SEC         log the counters every SEC seconds while running (default: 0, never)\n"
                 "\n"
-                ) % PACKAGE_NAME << std::endl;
+                ) % PACKAGE_NAME % Utils::intermediateCodecs() % Utils::intermediateCodec() << std::endl;
         return 256;
     }
 
@@ -83,7 +134,7 @@ private:
 };
 
 static const std::string shortopts = "c:s:t:p:m:xh";
-enum { OPT_HELP = 1, OPT_BATCH_SIZE, OPT_NO_RC };
+enum { OPT_HELP = 1, OPT_BATCH_SIZE, OPT_NO_RC, OPT_MAX_BLOCKS, OPT_MAX_INTERVAL, OPT_MAX_EXTENSIONS, OPT_SHARD, OPT_INTERMEDIATE_CODEC, OPT_STATS, OPT_STATS_INTERVAL };
 static const option longopts[] = {
     {"log4cxx",             required_argument,  NULL, 'c'}, 
     {"ini",                 required_argument,  NULL, 's'}, 
@@ -93,6 +144,13 @@ static const option longopts[] = {
     {"min-overlap",         required_argument,  NULL, 'm'}, 
     {"exhaustive",          no_argument,        NULL, 'x'}, 
     {"no-opposite-strand",  no_argument,        NULL, OPT_NO_RC}, 
+    {"max-overlap-blocks",  required_argument,  NULL, OPT_MAX_BLOCKS}, 
+    {"max-interval-size",   required_argument,  NULL, OPT_MAX_INTERVAL}, 
+    {"max-extensions",      required_argument,  NULL, OPT_MAX_EXTENSIONS}, 
+    {"shard",               required_argument,  NULL, OPT_SHARD}, 
+    {"intermediate-codec",  required_argument,  NULL, OPT_INTERMEDIATE_CODEC}, 
+    {"stats",               required_argument,  NULL, OPT_STATS}, 
+    {"stats-interval",      required_argument,  NULL, OPT_STATS_INTERVAL}, 
     {"help",                no_argument,        NULL, 'h'}, 
     {NULL, 0, NULL, 0}, 
 };
@@ -10,9 +10,13 @@
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
 
 #include <log4cxx/logger.h>
 
@@ -89,20 +93,20 @@ public:
     }
     void updateL(char c, const FMIndex* index) {
         // Update the left index using the difference between the AlphaCounts in the reverse table
-        DNAAlphabet::AlphaCount64 l = index->getOcc(_intervals[0].lower - 1);
-        DNAAlphabet::AlphaCount64 u = index->getOcc(_intervals[0].upper);
+        DNAAlphabet::AlphaCount64 l, u;
+        index->getOcc2(_intervals[0].lower - 1, _intervals[0].upper, &l, &u);
         updateL(c, index, l, u);
     } 
     void updateR(char c, const FMIndex* index) {
         // Update the left index using the difference between the AlphaCounts in the reverse table
-        DNAAlphabet::AlphaCount64 l = index->getOcc(_intervals[1].lower - 1);
-        DNAAlphabet::AlphaCount64 u = index->getOcc(_intervals[1].upper);
+        DNAAlphabet::AlphaCount64 l, u;
+        index->getOcc2(_intervals[1].lower - 1, _intervals[1].upper, &l, &u);
         updateR(c, index, l, u);
     }
-private:
-    friend std::ostream& operator<<(std::ostream& stream, const IntervalPair& pair);
-    friend std::istream& operator>>(std::istream& stream, IntervalPair& pair);
 
+    // Variants taking the occurrence counts at lower - 1 and upper of the interval
+    // being extended, so that several extensions of the same interval (e.g. the '$'
+    // probe and the next base) can share a single pair of rank queries.
     void updateL(char c, const FMIndex* index, const DNAAlphabet::AlphaCount64& l, const DNAAlphabet::AlphaCount64& u) {
         DNAAlphabet::AlphaCount64 diff = u - l;
         // Update the left index using the difference between the AlphaCounts in the reverse table
@@ -126,6 +130,39 @@ private:
         _intervals[1].upper = pb + u[DNAAlphabet::torank(c)] - 1;
     }
 
+    // Extend the pair to the left (right) with every symbol ($ACGT) at once. The child
+    // for symbol c is stored at children[DNAAlphabet::torank(c)], all of them are
+    // derived from the two rank queries on the interval being extended.
+    void extendAllL(const FMIndex* index, IntervalPair children[DNAAlphabet::ALL_SIZE]) const {
+        DNAAlphabet::AlphaCount64 l, u;
+        index->getOcc2(_intervals[0].lower - 1, _intervals[0].upper, &l, &u);
+        extendAll(0, index, l, u, children);
+    }
+    void extendAllR(const FMIndex* index, IntervalPair children[DNAAlphabet::ALL_SIZE]) const {
+        DNAAlphabet::AlphaCount64 l, u;
+        index->getOcc2(_intervals[1].lower - 1, _intervals[1].upper, &l, &u);
+        extendAll(1, index, l, u, children);
+    }
+private:
+    friend std::ostream& operator<<(std::ostream& stream, const IntervalPair& pair);
+    friend std::istream& operator>>(std::istream& stream, IntervalPair& pair);
+
+    // Extend the interval k directly and derive its twin from the difference
+    // between the AlphaCounts, as updateL/updateR do for a single symbol
+    void extendAll(size_t k, const FMIndex* index, const DNAAlphabet::AlphaCount64& l, const DNAAlphabet::AlphaCount64& u, IntervalPair children[DNAAlphabet::ALL_SIZE]) const {
+        size_t offset = _intervals[1 - k].lower;
+        for (size_t i = 0; i < DNAAlphabet::ALL_SIZE; ++i) {
+            size_t diff = u[i] - l[i];
+            children[i]._intervals[1 - k].lower = offset;
+            children[i]._intervals[1 - k].upper = offset + diff - 1;
+            offset += diff;
+
+            size_t pb = index->getPC(DNAAlphabet::tochar(i));
+            children[i]._intervals[k].lower = pb + l[i];
+            children[i]._intervals[k].upper = pb + u[i] - 1;
+        }
+    }
+
     FMIndex::Interval _intervals[2];
 };
 
@@ -172,12 +209,14 @@ struct OverlapBlock {
         return !af.test(AlignFlags::TARGETREV_BIT) ? rindex : index;
     }
 
-    DNAAlphabet::AlphaCount64 ext(const FMIndex* fmi, const FMIndex* rfmi) const {
-        DNAAlphabet::AlphaCount64 count = capped[1].ext(index(fmi, rfmi));
+    // All the right extensions of the capped interval. The children are indexed by the
+    // rank of the extension base in the canonical representation wrt the query.
+    void extendAll(const FMIndex* fmi, const FMIndex* rfmi, IntervalPair children[DNAAlphabet::ALL_SIZE]) const {
+        capped.extendAllR(index(fmi, rfmi), children);
         if (af.test(AlignFlags::QUERYCOMP_BIT)) {
-            count.complement();
+            std::swap(children[DNAAlphabet::torank('A')], children[DNAAlphabet::torank('T')]);
+            std::swap(children[DNAAlphabet::torank('C')], children[DNAAlphabet::torank('G')]);
         }
-        return count;
     }
 
     friend std::ostream& operator<<(std::ostream& stream, const OverlapBlock& block);
@@ -283,6 +322,10 @@ public:
     void process(const SequenceProcessFramework::SequenceWorkItem& workItem, const OverlapResult& result) {
         ASQG::VertexRecord record(workItem.read.name, workItem.read.seq);
         record.substring = result.substring ? 1 : 0;
+        if (result.aborted) {
+            record.aborted = 1;
+            _aborted.push_back(workItem.idx);
+        }
         if (!workItem.read.comment.empty()) {
             std::vector<std::string> tokens;
             ASQG::tokenize(tokens, workItem.read.comment, ' ');
@@ -295,13 +338,19 @@ public:
         _stream << record << '\n';
     }
 
+    // The indices of the reads whose overlap search was aborted
+    const std::vector<size_t>& aborted() const {
+        return _aborted;
+    }
+
 private:
     std::ostream& _stream;
+    std::vector<size_t> _aborted;
 };
 
 class Hit2OverlapConverter {
 public:
-    Hit2OverlapConverter(const SuffixArray& sa, const SuffixArray& rsa, DNASeqReader& reader) : _sa(sa), _rsa(rsa) {
+    Hit2OverlapConverter(const SuffixArray& sa, const SuffixArray& rsa, DNASeqReader& reader, const std::vector<size_t>& aborted=std::vector<size_t>()) : _sa(sa), _rsa(rsa) {
         reader.reset();
 
         size_t idx = 0;
@@ -311,6 +360,11 @@ public:
             _readinfo.push_back(ReadInfo(read.name, read.seq.length()));
             ++idx;
         }
+
+        _aborted.resize(_readinfo.size());
+        for (auto i : aborted) {
+            _aborted[i] = true;
+        }
     }
 
     size_t convert(const Hit& hit, OverlapList* overlaps) const {
@@ -326,7 +380,9 @@ public:
 
                 const SuffixArray& sa = block.af.test(AlignFlags::TARGETREV_BIT) ? _rsa : _sa;
                 const ReadInfo& target = _readinfo[sa[j].i];
-                if (query.name != target.name) {
+                // Each edge is written by one of its ends only, so the edges of an
+                // aborted read are dropped here rather than left partial
+                if (query.name != target.name && !_aborted[sa[j].i]) {
                     if (overlaps != NULL) {
                         Overlap o = block.overlap(query, target);
                         // The alignment logic above has the potential to produce duplicate alignments
@@ -349,11 +405,12 @@ private:
     const SuffixArray& _sa;
     const SuffixArray& _rsa;
     ReadInfoList _readinfo;
+    std::vector<bool> _aborted;
 };
 
 class Hits2ASQGConverter {
 public:
-    Hits2ASQGConverter(const SuffixArray& sa, const SuffixArray& rsa, DNASeqReader& reader) : _converter(sa, rsa, reader) {
+    Hits2ASQGConverter(const SuffixArray& sa, const SuffixArray& rsa, DNASeqReader& reader, const std::vector<size_t>& aborted=std::vector<size_t>()) : _converter(sa, rsa, reader, aborted) {
     }
 
     bool convert(const std::string& hits, std::ostream& asqg) const {
@@ -390,8 +447,19 @@ private:
     Hit2OverlapConverter _converter;
 };
 
-bool OverlapBuilder::build(DNASeqReader& reader, size_t minOverlap, std::ostream& output, size_t threads, size_t batch, size_t* processed) const {
+bool OverlapBuilder::build(DNASeqReader& reader, size_t minOverlap, std::ostream& output, size_t threads, size_t batch, size_t shard, size_t shards, size_t* processed) const {
     std::vector<std::string> hits;
+    std::vector<size_t> aborted;
+
+    // The range of reads [start, start + n) of this shard
+    assert(shard < shards);
+    size_t start = 0, n = -1;
+    std::string prefix = shardPrefix(_prefix, shard, shards);
+    if (shards > 1) {
+        start = _fmi->strings() * shard / shards;
+        n = _fmi->strings() * (shard + 1) / shards - start;
+        LOG4CXX_INFO(logger, boost::format("shard %d/%d: reads [%d, %d)") % (shard + 1) % shards % start % (start + n));
+    }
 
     // Build and write the ASQG header
     {
@@ -402,11 +470,15 @@ bool OverlapBuilder::build(DNASeqReader& reader, size_t minOverlap, std::ostream
         if (!infile.empty()) {
             record.infile(infile);
         }
+        if (shards > 1) {
+            record.shard(boost::str(boost::format("%d/%d") % (shard + 1) % shards));
+        }
         output << record << '\n';
     }
 
+    SequenceProcessFramework::SequenceWorkItemGenerator<SequenceProcessFramework::SequenceWorkItem> generator(reader, start);
     if (threads <= 1) { // single thread
-        std::string hit = _prefix + HITS_EXT + GZIP_EXT;
+        std::string hit = prefix + HITS_EXT + Utils::intermediateExt();
         std::shared_ptr<std::ostream> stream(Utils::ofstream(hit));
         if (!stream) {
             LOG4CXX_ERROR(logger, boost::format("failed to create hits %s") % hit);
@@ -421,19 +493,20 @@ bool OverlapBuilder::build(DNASeqReader& reader, size_t minOverlap, std::ostream
             SequenceProcessFramework::SequenceWorkItemGenerator<SequenceProcessFramework::SequenceWorkItem>, 
             OverlapProcess, 
             OverlapPostProcess
-            > worker;
-        size_t num = worker.run(reader, &proc, &postproc);
+            > worker("overlap");
+        size_t num = worker.run(generator, &proc, &postproc, n);
         if (processed != NULL) {
             *processed = num;
         }
+        LOG4CXX_INFO(logger, boost::format("%d of %d reads aborted by the overlap limits") % postproc.aborted().size() % num);
+        aborted = postproc.aborted();
 
         hits.push_back(hit);
     } else { // multi thread
-#ifdef _OPENMP
         std::vector<std::shared_ptr<std::ostream> > streamlist(threads);
         std::vector<OverlapProcess *> proclist(threads);
         for (size_t i = 0; i < threads; ++i) {
-            std::string hit = boost::str(boost::format("%s-thread%d%s%s") % _prefix % i % HITS_EXT % GZIP_EXT);
+            std::string hit = boost::str(boost::format("%s-thread%d%s%s") % prefix % i % HITS_EXT % Utils::intermediateExt());
             std::shared_ptr<std::ostream> stream(Utils::ofstream(hit));
             if (!stream) {
                 LOG4CXX_ERROR(logger, boost::format("failed to create hits %s") % hit);
@@ -451,18 +524,16 @@ bool OverlapBuilder::build(DNASeqReader& reader, size_t minOverlap, std::ostream
             SequenceProcessFramework::SequenceWorkItemGenerator<SequenceProcessFramework::SequenceWorkItem>, 
             OverlapProcess, 
             OverlapPostProcess
-            > worker;
-        size_t num = worker.run(reader, &proclist, &postproc, batch);
+            > worker("overlap");
+        size_t num = worker.run(generator, &proclist, &postproc, batch, n);
         if (processed != NULL) {
             *processed = num;
         }
+        LOG4CXX_INFO(logger, boost::format("%d of %d reads aborted by the overlap limits") % postproc.aborted().size() % num);
+        aborted = postproc.aborted();
         for (size_t i = 0; i < threads; ++i) {
             delete proclist[i];
         }
-#else
-        LOG4CXX_ERROR(logger, "failed to load OpenMP");
-        return false;
-#endif // _OPENMP
     }
 
     // Convert hits to ASQG
@@ -473,7 +544,7 @@ bool OverlapBuilder::build(DNASeqReader& reader, size_t minOverlap, std::ostream
             return false;
         }
 
-        Hits2ASQGConverter converter(*sa, *rsa, reader);
+        Hits2ASQGConverter converter(*sa, *rsa, reader, aborted);
         for (const auto& filename : hits) {
             LOG4CXX_INFO(logger, boost::format("parsing file %s") % filename);
             if (!converter.convert(filename, output)) {
@@ -486,18 +557,24 @@ bool OverlapBuilder::build(DNASeqReader& reader, size_t minOverlap, std::ostream
     return true;
 }
 
-bool OverlapBuilder::build(const std::string& input, size_t minOverlap, const std::string& output, size_t threads, size_t batch, size_t* processed) const {
-    // DNASeqReader
-    std::shared_ptr<std::istream> reads(Utils::ifstream(input));
-    if (!reads) {
-        LOG4CXX_ERROR(logger, boost::format("Failed to read file %s") % input);
-        return false;
+bool OverlapBuilder::build(const std::string& input, size_t minOverlap, const std::string& output, size_t threads, size_t batch, size_t shard, size_t shards, size_t* processed) const {
+    // DNASeqReader, a plain file is parsed on the threads too
+    std::shared_ptr<std::istream> reads;
+    std::shared_ptr<DNASeqReader> reader;
+    if (threads > 1) {
+        reader.reset(DNASeqReaderFactory::create(input, threads));
     }
-    std::shared_ptr<DNASeqReader> reader(DNASeqReaderFactory::create(*reads));
     if (!reader) {
-        reader->setAttr("infile", input);
-        LOG4CXX_ERROR(logger, boost::format("Failed to create DNASeqReader %s") % input);
-        return false;
+        reads.reset(Utils::ifstream(input));
+        if (!reads) {
+            LOG4CXX_ERROR(logger, boost::format("Failed to read file %s") % input);
+            return false;
+        }
+        reader.reset(DNASeqReaderFactory::create(*reads));
+        if (!reader) {
+            LOG4CXX_ERROR(logger, boost::format("Failed to create DNASeqReader %s") % input);
+            return false;
+        }
     }
 
     // ASQG
@@ -508,132 +585,600 @@ bool OverlapBuilder::build(const std::string& input, size_t minOverlap, const st
     }
 
     // Build
-    return build(*reader, minOverlap, *asqg, threads, batch, processed);
+    return build(*reader, minOverlap, *asqg, threads, batch, shard, shards, processed);
+}
+
+// Split the header of a shard into the header without its SH tag and the I/N of the shard
+static bool parseShardHeader(const std::string& line, std::string* header, size_t* shard, size_t* shards) {
+    std::vector<std::string> fields, kept;
+    ASQG::tokenize(fields, line, ASQG::FIELD_SEP);
+    bool found = false;
+    for (const auto& field : fields) {
+        if (boost::algorithm::starts_with(field, ASQG::SHARD_TAG + ASQG::TAG_SEP)) {
+            ASQG::StringTagValue tag;
+            std::vector<std::string> tokens;
+            if (found || !tag.fromstring(field)) {
+                return false;
+            }
+            boost::algorithm::split(tokens, (std::string)tag, boost::is_any_of("/"));
+            try {
+                if (tokens.size() != 2 || (*shard = boost::lexical_cast<size_t>(tokens[0])) < 1 || (*shards = boost::lexical_cast<size_t>(tokens[1])) < *shard) {
+                    return false;
+                }
+            } catch (const boost::bad_lexical_cast&) {
+                return false;
+            }
+            found = true;
+        } else {
+            kept.push_back(field);
+        }
+    }
+    *header = boost::algorithm::join(kept, std::string(1, ASQG::FIELD_SEP));
+    return found;
 }
 
+bool OverlapBuilder::merge(const std::vector<std::string>& inputs, std::ostream& output) {
+    // Every shard tells its I/N in the header, the shards are put back in
+    // order and must be exactly the N shards of one run
+    std::string header;
+    std::vector<std::string> shards;
+    for (const auto& input : inputs) {
+        std::shared_ptr<std::istream> stream(Utils::ifstream(input));
+        if (!stream) {
+            LOG4CXX_ERROR(logger, boost::format("failed to read shard %s") % input);
+            return false;
+        }
+
+        std::string line, other;
+        size_t i = 0, n = 0;
+        if (!std::getline(*stream, line) || ASQG::recordtype(line) != ASQG::RT_HEADER) {
+            LOG4CXX_ERROR(logger, boost::format("shard %s has no ASQG header") % input);
+            return false;
+        }
+        if (!parseShardHeader(line, &other, &i, &n)) {
+            LOG4CXX_ERROR(logger, boost::format("%s is not the output of overlap --shard") % input);
+            return false;
+        }
+
+        // The shards must have been built with the same parameters
+        if (shards.empty()) {
+            header = other;
+            shards.resize(n);
+        } else if (other != header) {
+            LOG4CXX_ERROR(logger, boost::format("shard %s has a different ASQG header") % input);
+            return false;
+        } else if (n != shards.size()) {
+            LOG4CXX_ERROR(logger, boost::format("shard %s is one of %d shards, expected %d") % input % n % shards.size());
+            return false;
+        }
+        if (!shards[i - 1].empty()) {
+            LOG4CXX_ERROR(logger, boost::format("shard %s and %s are both shard %d/%d") % shards[i - 1] % input % i % n);
+            return false;
+        }
+        shards[i - 1] = input;
+    }
+    for (size_t i = 0; i < shards.size(); ++i) {
+        if (shards[i].empty()) {
+            LOG4CXX_ERROR(logger, boost::format("shard %d/%d is missing") % (i + 1) % shards.size());
+            return false;
+        }
+    }
+    if (shards.empty()) {
+        LOG4CXX_ERROR(logger, "no shard to merge");
+        return false;
+    }
+    output << header << '\n';
+
+    // A shard only drops the edges to its own aborted reads, the edges to the
+    // aborted reads of the other shards are dropped here
+    std::set<std::string> aborted;
+
+    // All the vertex records come before the edge records in an ASQG, so the
+    // shards are read twice: once for the vertices and once for the edges
+    ASQG::RecordType types[] = {ASQG::RT_VERTEX, ASQG::RT_EDGE};
+    for (size_t k = 0; k < sizeof(types) / sizeof(types[0]); ++k) {
+        for (const auto& input : shards) {
+            std::shared_ptr<std::istream> stream(Utils::ifstream(input));
+            if (!stream) {
+                LOG4CXX_ERROR(logger, boost::format("failed to read shard %s") % input);
+                return false;
+            }
+
+            std::string line;
+            while (std::getline(*stream, line)) {
+                if (ASQG::recordtype(line) != types[k]) {
+                    continue;
+                }
+                if (types[k] == ASQG::RT_VERTEX) {
+                    ASQG::VertexRecord record;
+                    if (!ASQG::VertexRecord::parse(line, record)) {
+                        LOG4CXX_ERROR(logger, boost::format("shard %s has an invalid vertex record") % input);
+                        return false;
+                    }
+                    if (record.aborted && (int)record.aborted) {
+                        aborted.insert(record.id);
+                    }
+                } else if (!aborted.empty()) {
+                    ASQG::EdgeRecord record;
+                    if (!ASQG::EdgeRecord::parse(line, record)) {
+                        LOG4CXX_ERROR(logger, boost::format("shard %s has an invalid edge record") % input);
+                        return false;
+                    }
+                    const Overlap& overlap = record.overlap();
+                    if (aborted.find(overlap.id[0]) != aborted.end() || aborted.find(overlap.id[1]) != aborted.end()) {
+                        continue;
+                    }
+                }
+                output << line << '\n';
+            }
+        }
+        LOG4CXX_INFO(logger, boost::format("merged %s records of %d shards") % (types[k] == ASQG::RT_VERTEX ? "vertex" : "edge") % shards.size());
+    }
+    return true;
+}
+
+bool OverlapBuilder::merge(const std::vector<std::string>& inputs, const std::string& output) {
+    std::shared_ptr<std::ostream> asqg(Utils::ofstream(output));
+    if (!asqg) {
+        LOG4CXX_ERROR(logger, boost::format("Failed to create ASQG %s") % output);
+        return false;
+    }
+    return merge(inputs, *asqg);
+}
+
+std::string OverlapBuilder::shardPrefix(const std::string& prefix, size_t shard, size_t shards) {
+    if (shards > 1) {
+        return boost::str(boost::format("%s-shard%dof%d") % prefix % (shard + 1) % shards);
+    }
+    return prefix;
+}
+
+//
+// DuplicateTable - Groups the reads with exactly the same sequence on either
+// strand. The groups are keyed by a 128-bit hash of the canonical sequence (the
+// smaller of the read and its reverse complement).
+// The table is filled by all the threads, the locks are striped over the buckets.
+//
+class DuplicateTable {
+public:
+    struct Key {
+        Key() : reversed(false) {
+            hash[0] = hash[1] = 0;
+        }
+        bool operator==(const Key& k) const {
+            return hash[0] == k.hash[0] && hash[1] == k.hash[1];
+        }
+
+        uint64_t hash[2];
+        bool reversed; // the canonical sequence is the reverse complement of the read, not part of the key
+    };
+    struct Group {
+        Group(size_t first=-1, size_t size=0, bool reversed=false) : first(first), size(size), reversed(reversed) {
+        }
+        size_t first; // the lowest index of the reads in the group
+        size_t size;
+        bool reversed; // the strand of the first read
+    };
+
+    DuplicateTable(size_t stripes=64) : _locks(stripes), _buckets(stripes) {
+    }
+
+    static Key key(const std::string& seq) {
+        static thread_local std::string rc;
+        make_dna_reverse_complement_copy(seq, rc);
+        Key k;
+        k.reversed = rc < seq;
+        hash(k.reversed ? rc : seq, k.hash);
+        return k;
+    }
+
+    void insert(const Key& key, size_t idx) {
+        size_t i = key.hash[1] % _buckets.size();
+        std::lock_guard<std::mutex> lock(_locks[i]);
+        Group& g = _buckets[i][key];
+        if (idx < g.first) {
+            g.first = idx;
+            g.reversed = key.reversed;
+        }
+        ++g.size;
+    }
+
+    // Only safe once all the reads have been inserted
+    Group find(const Key& key) const {
+        const Bucket& bucket = _buckets[key.hash[1] % _buckets.size()];
+        auto i = bucket.find(key);
+        if (i != bucket.end()) {
+            return i->second;
+        }
+        return Group();
+    }
+
+    // The number of reads having an exact duplicate
+    size_t duplicates() const {
+        size_t n = 0;
+        for (const auto& bucket : _buckets) {
+            for (const auto& i : bucket) {
+                if (i.second.size > 1) {
+                    n += i.second.size;
+                }
+            }
+        }
+        return n;
+    }
+
+private:
+    struct KeyHasher {
+        size_t operator()(const Key& k) const {
+            return k.hash[0];
+        }
+    };
+    typedef std::unordered_map<Key, Group, KeyHasher> Bucket;
+
+    // Two independent 64-bit multiply-xorshift hashes over 8-byte words
+    static void hash(const std::string& seq, uint64_t h[2]) {
+        static const uint64_t m1 = 0x9e3779b97f4a7c15ULL, m2 = 0xc2b2ae3d27d4eb4fULL;
+
+        h[0] = 0x243f6a8885a308d3ULL ^ seq.length(), h[1] = 0x13198a2e03707344ULL ^ (seq.length() * m1);
+        for (size_t i = 0; i < seq.length(); i += 8) {
+            uint64_t w = 0;
+            memcpy(&w, seq.data() + i, std::min((size_t)8, seq.length() - i));
+            h[0] = mix((h[0] ^ w) * m1);
+            h[1] = mix((h[1] + w) * m2);
+        }
+        h[0] = mix(h[0] ^ (h[1] >> 29));
+        h[1] = mix(h[1] ^ (h[0] >> 31));
+    }
+    static uint64_t mix(uint64_t x) {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        x ^= x >> 33;
+        return x;
+    }
+
+    std::vector<std::mutex> _locks;
+    std::vector<Bucket> _buckets;
+};
+
+//
+// DuplicateGroupProcess - Add the reads into the table of exact duplicates
+//
+class DuplicateGroupProcess {
+public:
+    DuplicateGroupProcess(DuplicateTable* table) : _table(table) {
+    }
+
+    bool process(const SequenceProcessFramework::SequenceWorkItem& workItem) {
+        _table->insert(DuplicateTable::key(workItem.read.seq), workItem.idx);
+        return true;
+    }
+
+private:
+    DuplicateTable* _table;
+};
+
+class DuplicateGroupPostProcess {
+public:
+    void process(const SequenceProcessFramework::SequenceWorkItem&, bool) {
+    }
+};
+
 //
 // DuplicateRemoveProcess
 //
+struct DuplicateRemoveResult {
+    DuplicateRemoveResult() : flipped(false) {
+    }
+    Hit hit;
+    DuplicateTable::Group group;
+    bool flipped; // the read is on the other strand than the first read of its group
+};
+
 class DuplicateRemoveProcess {
 public:
-    DuplicateRemoveProcess(const OverlapBuilder* builder, std::ostream& stream) : _builder(builder), _stream(stream) {
+    DuplicateRemoveProcess(const OverlapBuilder* builder, const DuplicateTable* table) : _builder(builder), _table(table) {
     }
 
-    OverlapResult process(const SequenceProcessFramework::SequenceWorkItem& workItem) {
-        Hit hit(workItem.idx);
-        OverlapResult result = _builder->duplicate(workItem.read, &hit.blocks);
-        hit.substring = result.substring;
-        _stream << workItem.read.name << '\t' << workItem.read.seq << '\t' << hit << '\n';
-
-        return result;
+    DuplicateRemoveResult process(const SequenceProcessFramework::SequenceWorkItem& workItem) {
+        DuplicateRemoveResult r;
+        r.hit.idx = workItem.idx;
+        DuplicateTable::Key key = DuplicateTable::key(workItem.read.seq);
+        r.group = _table->find(key);
+        r.flipped = key.reversed != r.group.reversed;
+
+        // Only the first read of a group of exact duplicates is searched, the
+        // others get its overlap blocks, flipped to their strand, in the post process
+        if (r.group.size <= 1 || r.group.first == workItem.idx) {
+            OverlapResult result = _builder->duplicate(workItem.read, &r.hit.blocks);
+            r.hit.substring = result.substring;
+        }
+        return r;
     }
 
 private:
     const OverlapBuilder* _builder;
-    std::ostream& _stream;
+    const DuplicateTable* _table;
 };
 
 //
-// DuplicateRemovePostProcess
+// DuplicateRemovePostProcess - Write the hits in the order of the reads
 //
 class DuplicateRemovePostProcess {
 public:
-    DuplicateRemovePostProcess() {
+    DuplicateRemovePostProcess(const OverlapBuilder* builder, std::ostream& stream) : _builder(builder), _stream(stream) {
     }
 
-    void process(const SequenceProcessFramework::SequenceWorkItem& workItem, const OverlapResult& result) {
+    void process(const SequenceProcessFramework::SequenceWorkItem& workItem, const DuplicateRemoveResult& result) {
+        const DNASeq& read = workItem.read;
+        Hit hit = result.hit;
+
+        // The reads are processed in order, so the first read of a group is
+        // always seen before the other ones
+        if (result.group.size > 1) {
+            if (result.group.first == hit.idx) {
+                _cache[hit.idx] = CachedHit(read.seq, hit, result.group.size - 1);
+            } else {
+                auto i = _cache.find(result.group.first);
+                assert(i != _cache.end());
+                if (!result.flipped && i->second.seq == read.seq) {
+                    hit.substring = i->second.hit.substring;
+                    hit.blocks = i->second.hit.blocks;
+                } else if (result.flipped && make_dna_reverse_complement_copy(i->second.seq) == read.seq) {
+                    hit.substring = i->second.hit.substring;
+                    flip(i->second.hit.blocks, &hit.blocks);
+                } else { // hash collision
+                    hit.substring = _builder->duplicate(read, &hit.blocks).substring;
+                }
+                if (--i->second.remaining == 0) {
+                    _cache.erase(i);
+                }
+            }
+        }
+
+        _stream << read.name << '\t' << read.seq << '\t' << hit << '\n';
     }
-};
 
-class Hits2FastaConverter {
-public:
-    Hits2FastaConverter(const SuffixArray& sa, const SuffixArray& rsa, DNASeqReader& reader) : _converter(sa, rsa, reader) {
+private:
+    // The blocks of the reverse complement of a read. The forward blocks of one
+    // strand are the reverse complement blocks of the other with the intervals of
+    // the two indices swapped, the forward blocks come first as duplicate() does.
+    static void flip(const OverlapBlockList& blocks, OverlapBlockList* flipped) {
+        OverlapBlockList rcblocks;
+        for (const auto& block : blocks) {
+            OverlapBlock b(block);
+            std::swap(b.capped[0], b.capped[1]);
+            std::swap(b.raw[0], b.raw[1]);
+            if (block.af.test(AlignFlags::TARGETREV_BIT)) {
+                b.af = kSuffixPrefixAF;
+                flipped->push_back(b);
+            } else {
+                b.af = kSuffixSuffixAF;
+                rcblocks.push_back(b);
+            }
+        }
+        flipped->splice(flipped->end(), rcblocks);
     }
 
-    bool convert(const std::string& hits, std::ostream& fasta, std::ostream& duplicates) const {
-        std::shared_ptr<std::istream> stream(Utils::ifstream(hits));
-        if (!stream) {
-            LOG4CXX_ERROR(logger, boost::format("failed to read hits %s") % hits);
-            return false;
+    struct CachedHit {
+        CachedHit(const std::string& seq="", const Hit& hit=Hit(), size_t remaining=0) : seq(seq), hit(hit), remaining(remaining) {
         }
-        return convert(*stream, fasta, duplicates);
+        std::string seq;
+        Hit hit;
+        size_t remaining;
+    };
+
+    const OverlapBuilder* _builder;
+    std::ostream& _stream;
+    std::unordered_map<size_t, CachedHit> _cache;
+};
+
+//
+// HitsLineGenerator - Generate the non-empty lines of a hits file as work items
+//
+class HitsLineGenerator {
+public:
+    HitsLineGenerator(std::istream& stream) : _stream(stream), _consumed(0) {
     }
 
-    bool convert(std::istream& hits, std::ostream& fasta, std::ostream& duplicates) const {
-        std::string line;
-        while (std::getline(hits, line)) {
+    bool generate(std::string& line) {
+        while (std::getline(_stream, line)) {
             boost::algorithm::trim(line);
             if (!line.empty()) {
-                // Read the overlap block for a read
-                DNASeq item;
-                Hit hit;
-                std::stringstream ss(line);
-                ss >> item.name >> item.seq >> hit;
+                ++_consumed;
+                return true;
+            }
+        }
+        return false;
+    }
 
-                OverlapList overlaps;
-                size_t numCopies = _converter.convert(hit, &overlaps);
+    size_t consumed() const {
+        return _consumed;
+    }
+private:
+    std::istream& _stream;
+    size_t _consumed;
+};
 
-                bool isContained = hit.substring;
-                if (!isContained) {
-                    for (const auto& o : overlaps) {
-                        if (o.isContainment() && o.containedIdx() == 0) {
-                            isContained = true;
-                            break;
-                        }
-                    }
-                }
+class Hits2FastaConverter {
+public:
+    struct Result {
+        Result() : contained(false) {
+        }
+        DNASeq read;
+        bool contained;
+    };
 
-                std::string meta = boost::str(boost::format("%s NumDuplicates=%d") % item.name % numCopies);
-                if (isContained) {
-                    // The read's index in the sequence data base
-                    // is needed when removing it from the FM-index.
-                    // In the output fasta, we set the reads ID to be the index
-                    // and record its old id in the fasta header.
-                    item.name = boost::str(
-                            boost::format("%s,seqrank=%d %s") % item.name % hit.idx % meta
-                            );
-                    duplicates << item;
-                } else {
-                    item.name = boost::str(boost::format("%s %s") % item.name % meta);
-                    fasta << item;
+    Hits2FastaConverter(const SuffixArray& sa, const SuffixArray& rsa, DNASeqReader& reader) : _converter(sa, rsa, reader) {
+    }
+
+    // Decide whether the read in a line of hits is a duplicate, the converter
+    // is only read here so a single one can be shared by all the threads.
+    Result convert(const std::string& line) const {
+        // Read the overlap block for a read
+        Result r;
+        DNASeq& item = r.read;
+        Hit hit;
+        std::stringstream ss(line);
+        ss >> item.name >> item.seq >> hit;
+
+        OverlapList overlaps;
+        size_t numCopies = _converter.convert(hit, &overlaps);
+
+        bool isContained = hit.substring;
+        if (!isContained) {
+            for (const auto& o : overlaps) {
+                if (o.isContainment() && o.containedIdx() == 0) {
+                    isContained = true;
+                    break;
                 }
             }
         }
-        return true;
+
+        std::string meta = boost::str(boost::format("%s NumDuplicates=%d") % item.name % numCopies);
+        if (isContained) {
+            // The read's index in the sequence data base
+            // is needed when removing it from the FM-index.
+            // In the output fasta, we set the reads ID to be the index
+            // and record its old id in the fasta header.
+            item.name = boost::str(
+                    boost::format("%s,seqrank=%d %s") % item.name % hit.idx % meta
+                    );
+        } else {
+            item.name = boost::str(boost::format("%s %s") % item.name % meta);
+        }
+        r.contained = isContained;
+
+        return r;
     }
 
 private:
     Hit2OverlapConverter _converter;
 };
 
-bool OverlapBuilder::rmdup(DNASeqReader& reader, std::ostream& output, std::ostream& duplicates, size_t threads, size_t* processed) const {
-    std::vector<std::string> hits;
+//
+// Hits2FastaProcess
+//
+class Hits2FastaProcess {
+public:
+    Hits2FastaProcess(const Hits2FastaConverter& converter) : _converter(converter) {
+    }
 
-    if (threads <= 1) { // single thread
-        std::string hit = _prefix + RMDUP_EXT + HITS_EXT + GZIP_EXT;
-        std::shared_ptr<std::ostream> stream(Utils::ofstream(hit));
+    Hits2FastaConverter::Result process(const std::string& line) {
+        return _converter.convert(line);
+    }
+
+private:
+    const Hits2FastaConverter& _converter;
+};
+
+//
+// Hits2FastaPostProcess
+//
+class Hits2FastaPostProcess {
+public:
+    Hits2FastaPostProcess(std::ostream& fasta, std::ostream& duplicates) : _fasta(fasta), _duplicates(duplicates) {
+    }
+
+    void process(const std::string&, const Hits2FastaConverter::Result& result) {
+        if (result.contained) {
+            _duplicates << result.read;
+        } else {
+            _fasta << result.read;
+        }
+    }
+
+private:
+    std::ostream& _fasta;
+    std::ostream& _duplicates;
+};
+
+bool OverlapBuilder::rmdup(DNASeqReader& reader, std::ostream& output, std::ostream& duplicates, size_t threads, size_t* processed, bool prefilter) const {
+    // Group the exact duplicates first, only one read of each group needs
+    // to be searched in the FM-index
+    DuplicateTable table;
+    if (prefilter) {
+        DuplicateGroupPostProcess postproc;
+
+        if (threads <= 1) { // single thread
+            DuplicateGroupProcess proc(&table);
+
+            SequenceProcessFramework::SerialWorker<
+                SequenceProcessFramework::SequenceWorkItem, 
+                bool, 
+                SequenceProcessFramework::SequenceWorkItemGenerator<SequenceProcessFramework::SequenceWorkItem>, 
+                DuplicateGroupProcess, 
+                DuplicateGroupPostProcess
+                > worker("rmdup-group");
+            worker.run(reader, &proc, &postproc);
+        } else { // multi thread
+            std::vector<DuplicateGroupProcess *> proclist(threads);
+            for (size_t i = 0; i < threads; ++i) {
+                proclist[i] = new DuplicateGroupProcess(&table);
+            }
+
+            SequenceProcessFramework::ParallelWorker<
+                SequenceProcessFramework::SequenceWorkItem, 
+                bool, 
+                SequenceProcessFramework::SequenceWorkItemGenerator<SequenceProcessFramework::SequenceWorkItem>, 
+                DuplicateGroupProcess, 
+                DuplicateGroupPostProcess
+                > worker("rmdup-group");
+            worker.run(reader, &proclist, &postproc);
+            for (size_t i = 0; i < threads; ++i) {
+                delete proclist[i];
+            }
+        }
+        LOG4CXX_INFO(logger, boost::format("%d reads have exact duplicates") % table.duplicates());
+        reader.reset();
+    }
+
+    // The hits are written in the order of the reads by all the threads,
+    // so the output does not depend on the number of threads
+    std::string hits = _prefix + RMDUP_EXT + HITS_EXT + Utils::intermediateExt();
+    {
+        std::shared_ptr<std::ostream> stream(Utils::ofstream(hits));
         if (!stream) {
-            LOG4CXX_ERROR(logger, boost::format("failed to create hits %s") % hit);
+            LOG4CXX_ERROR(logger, boost::format("failed to create hits %s") % hits);
             return false;
         }
-        DuplicateRemoveProcess proc(this, *stream);
-        DuplicateRemovePostProcess postproc;
+        DuplicateRemovePostProcess postproc(this, *stream);
+
+        if (threads <= 1) { // single thread
+            DuplicateRemoveProcess proc(this, &table);
+
+            SequenceProcessFramework::SerialWorker<
+                SequenceProcessFramework::SequenceWorkItem, 
+                DuplicateRemoveResult, 
+                SequenceProcessFramework::SequenceWorkItemGenerator<SequenceProcessFramework::SequenceWorkItem>, 
+                DuplicateRemoveProcess, 
+                DuplicateRemovePostProcess
+                > worker("rmdup");
+            size_t num = worker.run(reader, &proc, &postproc);
+            if (processed != NULL) {
+                *processed = num;
+            }
+        } else { // multi thread
+            std::vector<DuplicateRemoveProcess *> proclist(threads);
+            for (size_t i = 0; i < threads; ++i) {
+                proclist[i] = new DuplicateRemoveProcess(this, &table);
+            }
 
-        SequenceProcessFramework::SerialWorker<
-            SequenceProcessFramework::SequenceWorkItem, 
-            OverlapResult, 
-            SequenceProcessFramework::SequenceWorkItemGenerator<SequenceProcessFramework::SequenceWorkItem>, 
-            DuplicateRemoveProcess, 
-            DuplicateRemovePostProcess
-            > worker;
-        size_t num = worker.run(reader, &proc, &postproc);
-        if (processed != NULL) {
-            *processed = num;
+            SequenceProcessFramework::ParallelWorker<
+                SequenceProcessFramework::SequenceWorkItem, 
+                DuplicateRemoveResult, 
+                SequenceProcessFramework::SequenceWorkItemGenerator<SequenceProcessFramework::SequenceWorkItem>, 
+                DuplicateRemoveProcess, 
+                DuplicateRemovePostProcess
+                > worker("rmdup");
+            size_t num = worker.run(reader, &proclist, &postproc);
+            if (processed != NULL) {
+                *processed = num;
+            }
+            for (size_t i = 0; i < threads; ++i) {
+                delete proclist[i];
+            }
         }
-
-        hits.push_back(hit);
-    } else { // multi thread
-        assert(false);
     }
 
     // Convert hits to fasta
@@ -644,12 +1189,44 @@ bool OverlapBuilder::rmdup(DNASeqReader& reader, std::ostream& output, std::ostr
             return false;
         }
 
+        LOG4CXX_INFO(logger, boost::format("parsing file %s") % hits);
+        std::shared_ptr<std::istream> stream(Utils::ifstream(hits));
+        if (!stream) {
+            LOG4CXX_ERROR(logger, boost::format("failed to read hits %s") % hits);
+            return false;
+        }
+
         Hits2FastaConverter converter(*sa, *rsa, reader);
-        for (const auto& filename : hits) {
-            LOG4CXX_INFO(logger, boost::format("parsing file %s") % filename);
-            if (!converter.convert(filename, output, duplicates)) {
-                LOG4CXX_ERROR(logger, boost::format("failed to convert hits to asqg %s") % filename);
-                return false;
+        HitsLineGenerator generator(*stream);
+        Hits2FastaPostProcess postproc(output, duplicates);
+
+        if (threads <= 1) { // single thread
+            Hits2FastaProcess proc(converter);
+
+            SequenceProcessFramework::SerialWorker<
+                std::string, 
+                Hits2FastaConverter::Result, 
+                HitsLineGenerator, 
+                Hits2FastaProcess, 
+                Hits2FastaPostProcess
+                > worker("rmdup-fasta");
+            worker.run(generator, &proc, &postproc);
+        } else { // multi thread
+            std::vector<Hits2FastaProcess *> proclist(threads);
+            for (size_t i = 0; i < threads; ++i) {
+                proclist[i] = new Hits2FastaProcess(converter);
+            }
+
+            SequenceProcessFramework::ParallelWorker<
+                std::string, 
+                Hits2FastaConverter::Result, 
+                HitsLineGenerator, 
+                Hits2FastaProcess, 
+                Hits2FastaPostProcess
+                > worker("rmdup-fasta");
+            worker.run(generator, &proclist, &postproc);
+            for (size_t i = 0; i < threads; ++i) {
+                delete proclist[i];
             }
         }
     }
@@ -657,7 +1234,7 @@ bool OverlapBuilder::rmdup(DNASeqReader& reader, std::ostream& output, std::ostr
     return true;
 }
 
-bool OverlapBuilder::rmdup(const std::string& input, const std::string& output, const std::string& duplicates, size_t threads, size_t* processed) const {
+bool OverlapBuilder::rmdup(const std::string& input, const std::string& output, const std::string& duplicates, size_t threads, size_t* processed, bool prefilter) const {
     // DNASeqReader
     std::ifstream reads(input);
     std::shared_ptr<DNASeqReader> reader(DNASeqReaderFactory::create(reads));
@@ -675,18 +1252,18 @@ bool OverlapBuilder::rmdup(const std::string& input, const std::string& output,
 
     // DUPLICATES 
     std::shared_ptr<std::ostream> dup(Utils::ofstream(duplicates));
-    if (!fasta) {
+    if (!dup) {
         LOG4CXX_ERROR(logger, boost::format("Failed to create dup FASTA %s") % duplicates);
         return false;
     }
 
     // Build
-    return rmdup(*reader, *fasta, *dup, threads, processed);
+    return rmdup(*reader, *fasta, *dup, threads, processed, prefilter);
 }
 
 class IrreducibleBlockListExtractor {
 public:
-    IrreducibleBlockListExtractor(const FMIndex* fmi, const FMIndex* rfmi) : _fmi(fmi), _rfmi(rfmi) {
+    IrreducibleBlockListExtractor(const FMIndex* fmi, const FMIndex* rfmi, size_t maxSteps=0) : _fmi(fmi), _rfmi(rfmi), _maxSteps(maxSteps) {
     }
 
     bool extract(OverlapBlockList* inblocks, OverlapBlockList* outblocks) {
@@ -701,20 +1278,33 @@ public:
         typedef std::list<OverlapBlockList> BlockGroups;
 
         BlockGroups groups = {*inblocks};
+        size_t steps = 0;
         while (!groups.empty()) {
             // Perform one extenion round for each group.
             // If the top-level block has ended, push the result
             // to the final list and remove the group from processing
             BlockGroups incomings; // Branched blocks are placed here
-            for (auto i = groups.begin(); i != groups.end(); ++i) {
+            for (auto i = groups.begin(); i != groups.end(); ) {
                 OverlapBlockList& blocklist = *i;
                 bool eraseGroup = true;
 
+                if (_maxSteps > 0 && ++steps > _maxSteps) {
+                    LOG4CXX_DEBUG(logger, boost::format("more than %d extension steps, give up") % _maxSteps);
+                    return false;
+                }
+
+                // The right extensions of every block in the group, in the same order as the
+                // blocks. They are computed once per round and used both to count the
+                // extension bases and to update the blocks.
+                BlockExtensionList extensions;
+                extensions.reserve(blocklist.size());
+
                 // Count the extensions in the top level (longest) blocks first
                 DNAAlphabet::AlphaCount64 exts;
                 size_t topLength = blocklist.front().length;
                 for (auto j = blocklist.begin(); j != blocklist.end() && j->length == topLength; ++j) {
-                    exts += j->ext(_fmi, _rfmi);
+                    extensions.push_back(BlockExtension(*j, _fmi, _rfmi));
+                    exts += extensions.back().counts();
                 }
 
                 // Three cases:
@@ -730,9 +1320,9 @@ public:
                     // (one in the forward and reverse direction). Since we can't decide which one
                     // contains the other at this point, we output hits to both. Under a fixed 
                     // length string assumption one will be contained within the other and removed later.
-                    for (auto j = blocklist.begin(); j != blocklist.end() && j->length == topLength; ++j) {
-                        DNAAlphabet::AlphaCount64 test = j->ext(_fmi, _rfmi);
-                        if (test[DNAAlphabet::torank('$')] == 0) {
+                    auto k = extensions.begin();
+                    for (auto j = blocklist.begin(); j != blocklist.end() && j->length == topLength; ++j, ++k) {
+                        if (k->counts()[DNAAlphabet::torank('$')] == 0) {
                             LOG4CXX_ERROR(logger, "substring read found during overlap computation.");
                             LOG4CXX_ERROR(logger, "Please run rmdup before  overlap.");
                             return false;
@@ -740,27 +1330,24 @@ public:
 
                         // Perform the final right-update to make the block terminal
                         OverlapBlock branched = *j;
-                        branched.capped.updateR('$', branched.index(_fmi, _rfmi));
+                        branched.capped = k->children[DNAAlphabet::torank('$')];
                         outblocks->push_back(branched);
 
                         LOG4CXX_DEBUG(logger, boost::format("TLB of length %d has ended") % branched.length);
                     }
                 } else {
                     // Count the extension for the rest of the blocks
-                    for (auto j = blocklist.begin(); j != blocklist.end(); ++j) {
-                        if (j->length < topLength) {
-                            exts += j->ext(_fmi, _rfmi);
-                        }
+                    for (auto j = std::next(blocklist.begin(), extensions.size()); j != blocklist.end(); ++j) {
+                        extensions.push_back(BlockExtension(*j, _fmi, _rfmi));
+                        exts += extensions.back().counts();
                     }
 
                     // If only one of the DNA characters has a non-zero count
                     if (std::count_if(&exts[0], &exts[0] + exts.size(), std::bind2nd(std::greater<uint64_t>(), 0)) == 1) {
                         // Update all the blocks using the unique extension character
                         // This character is in the canonical representation wrt to the query
-                        char c = DNAAlphabet::tochar(
-                                std::find_if(&exts[0], &exts[0] + exts.size(), std::bind2nd(std::greater<uint64_t>(), 0)) - &exts[0]
-                                );
-                        updateR(c, &blocklist);
+                        size_t rank = std::find_if(&exts[0], &exts[0] + exts.size(), std::bind2nd(std::greater<uint64_t>(), 0)) - &exts[0];
+                        updateR(rank, extensions, &blocklist);
 
                         // Set the flag to erase this group, it is finished
                         eraseGroup = false;
@@ -768,7 +1355,7 @@ public:
                         for (size_t j = 0; j < exts.size(); ++j) {
                             if (exts[j] > 0) {
                                 OverlapBlockList branched = blocklist;
-                                updateR(DNAAlphabet::tochar(j), &branched);
+                                updateR(j, extensions, &branched);
                                 incomings.push_back(branched);
                             }
                         }
@@ -795,12 +1382,30 @@ private:
             return x.length > y.length;
         }
     };
-    void updateR(char c, OverlapBlockList* blocks) {
-        assert(blocks != NULL);
+
+    // The children of an overlap block for each extension base
+    struct BlockExtension {
+        BlockExtension(const OverlapBlock& block, const FMIndex* fmi, const FMIndex* rfmi) {
+            block.extendAll(fmi, rfmi, children);
+        }
+        DNAAlphabet::AlphaCount64 counts() const {
+            DNAAlphabet::AlphaCount64 c;
+            for (size_t i = 0; i < DNAAlphabet::ALL_SIZE; ++i) {
+                c[i] = children[i][1].size();
+            }
+            return c;
+        }
+        IntervalPair children[DNAAlphabet::ALL_SIZE];
+    };
+    typedef std::vector<BlockExtension> BlockExtensionList;
+
+    // Move every block to its child for the extension base of the given rank. The
+    // extensions are in the same order as the blocks.
+    void updateR(size_t rank, const BlockExtensionList& extensions, OverlapBlockList* blocks) {
+        assert(blocks != NULL && blocks->size() == extensions.size());
         auto i = blocks->begin();
-        while (i != blocks->end()) {
-            char b = i->af.test(AlignFlags::QUERYCOMP_BIT) ? make_dna_complement(c) : c;
-            i->capped.updateR(b, i->index(_fmi, _rfmi));
+        for (auto j = extensions.begin(); j != extensions.end(); ++j) {
+            i->capped = j->children[rank];
 
             // remove the block from the list if its no longer valid
             if (!i->capped.valid()) {
@@ -813,6 +1418,34 @@ private:
 
     const FMIndex* _fmi;
     const FMIndex* _rfmi;
+    size_t _maxSteps;
+};
+
+//
+// StrandedSeq - A read viewed on one of its four strands (forward, reverse,
+// complement or reverse complement). The bases are mapped on the fly so the
+// strand searches need no copy of the read.
+//
+class StrandedSeq {
+public:
+    StrandedSeq(const std::string& seq, bool reverse=false, bool complement=false) : _seq(seq), _reverse(reverse), _complement(complement) {
+    }
+
+    size_t length() const {
+        return _seq.length();
+    }
+    bool empty() const {
+        return _seq.empty();
+    }
+    char operator[](size_t i) const {
+        assert(i < _seq.length());
+        char c = _reverse ? _seq[_seq.length() - i - 1] : _seq[i];
+        return _complement ? make_dna_complement(c) : c;
+    }
+private:
+    const std::string& _seq;
+    bool _reverse;
+    bool _complement;
 };
 
 class OverlapBlockFinder {
@@ -822,7 +1455,7 @@ public:
 
     // Calculate the ranges in FMI that contain a prefix of at least minOverlap basepairs that
     // overlaps with a suffix of w. The ranges are added to the pOBList
-    void find(const std::string& seq, const AlignFlags& af, OverlapBlockList* overlaps, OverlapBlockList* contains, OverlapResult* result) const {
+    void find(const StrandedSeq& seq, const AlignFlags& af, OverlapBlockList* overlaps, OverlapBlockList* contains, OverlapResult* result) const {
         assert(!seq.empty());
         // The algorithm is as follows:
         // We perform a backwards search using the FM-index for the string seq.
@@ -834,11 +1467,21 @@ public:
 
         // Collect the OverlapBlocks
         for (size_t i = l - 1; i > 0; --i) {
+            // Once the range is empty it stays empty, no more overlaps or
+            // containments can be found for this strand
+            if (!ranges.valid()) {
+                return;
+            }
+
+            // The '$' probe and the extension with the next base are both
+            // children of the range
+            IntervalPair children[DNAAlphabet::ALL_SIZE];
+            ranges.extendAllL(_fmi, children);
+
             if (l - i >= _minOverlap) {
                 // Calculate which of the prefixes that match w[i, l] are terminal
                 // These are the proper prefixes (they are the start of a read)
-                IntervalPair probe = ranges;
-                probe.updateL('$', _fmi);
+                const IntervalPair& probe = children[DNAAlphabet::torank('$')];
 
                 // The probe interval contains the range of proper prefixes
                 if (probe[1].valid()) {
@@ -850,7 +1493,10 @@ public:
             }
 
             // Compare the range of the suffix seq[i, l]
-            ranges.updateL(seq[i - 1], _fmi);
+            ranges = children[DNAAlphabet::torank(seq[i - 1])];
+        }
+        if (!ranges.valid()) {
+            return;
         }
 
         // Determine if this sequence is contained and should not be processed further
@@ -864,15 +1510,17 @@ public:
 
         // Case 1 is indicated by the existance of a non-$ left or right hand extension
         // In this case we return no alignments for the string
-        // DNAAlphabet::AlphaCount64 lext =  _fmi->getOcc(ranges[0].upper) -  _fmi->getOcc(ranges[0].lower - 1);
-        DNAAlphabet::AlphaCount64 lext =  ranges[0].ext(_fmi);
-        // DNAAlphabet::AlphaCount64 rext = _rfmi->getOcc(ranges[1].upper) - _rfmi->getOcc(ranges[1].lower - 1);
-        DNAAlphabet::AlphaCount64 rext =  ranges[1].ext(_rfmi);
+        IntervalPair children[DNAAlphabet::ALL_SIZE];
+        ranges.extendAllL(_fmi, children);
+        DNAAlphabet::AlphaCount64 lext;
+        for (size_t i = 0; i < DNAAlphabet::ALL_SIZE; ++i) {
+            lext[i] = children[i][0].size();
+        }
+        DNAAlphabet::AlphaCount64 rext = ranges[1].ext(_rfmi);
         if (lext.hasDNA() || rext.hasDNA()) {
             result->substring = true;
         } else {
-            IntervalPair probe = ranges;
-            probe.updateL('$', _fmi);
+            IntervalPair probe = children[DNAAlphabet::torank('$')];
             if (probe.valid()) {
                 // terminate the contained block and add it to the contained list
                 probe.updateR('$', _rfmi);
@@ -1069,6 +1717,30 @@ private:
     const FMIndex* _rfmi;
 };
 
+class OverlapBlockLimiter {
+public:
+    OverlapBlockLimiter(const OverlapBuilder::Limits& limits) : _limits(limits), _blocks(0) {
+    }
+    // Returns false once the blocks checked so far exceed the limits
+    bool check(const OverlapBlockList& blocks) {
+        _blocks += blocks.size();
+        if (_limits.maxBlocks > 0 && _blocks > _limits.maxBlocks) {
+            return false;
+        }
+        if (_limits.maxInterval > 0) {
+            for (const auto& block : blocks) {
+                if (block.capped[0].size() > _limits.maxInterval) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+private:
+    const OverlapBuilder::Limits& _limits;
+    size_t _blocks;
+};
+
 class ContainmentBlockRemover {
 public:
     ContainmentBlockRemover(size_t seqlen) : _seqlen(seqlen) {
@@ -1099,15 +1771,25 @@ OverlapResult OverlapBuilder::overlap(const DNASeq& read, size_t minOverlap, Ove
 
     OverlapBlockList suffixfwd, suffixrev, prefixfwd, prefixrev, containfwd, containrev;
     // Match the suffix of seq to prefixes
-    finder.find(seq, kSuffixPrefixAF, &suffixfwd, &containfwd, &result);
+    finder.find(StrandedSeq(seq), kSuffixPrefixAF, &suffixfwd, &containfwd, &result);
     if (_rc) {
-        finder.find(make_dna_reverse_complement_copy(seq), kPrefixPrefixAF, &prefixfwd, &containfwd, &result);
+        finder.find(StrandedSeq(seq, true, true), kPrefixPrefixAF, &prefixfwd, &containfwd, &result);
     }
 
     // Match the prefix of seq to suffixes
-    rfinder.find(make_dna_reverse_copy(seq), kPrefixSuffixAF, &prefixrev, &containrev, &result);
+    rfinder.find(StrandedSeq(seq, true, false), kPrefixSuffixAF, &prefixrev, &containrev, &result);
     if (_rc) {
-        rfinder.find(make_dna_complement_copy(seq), kSuffixSuffixAF, &suffixrev, &containrev, &result);
+        rfinder.find(StrandedSeq(seq, false, true), kSuffixSuffixAF, &suffixrev, &containrev, &result);
+    }
+
+    // Give up early on reads from highly repetitive sequences, resolving
+    // and converting their blocks would dominate the running time
+    {
+        OverlapBlockLimiter limiter(_limits);
+        if (!limiter.check(suffixfwd) || !limiter.check(prefixfwd) || !limiter.check(suffixrev) || !limiter.check(prefixrev) || !limiter.check(containfwd) || !limiter.check(containrev)) {
+            result.aborted = true;
+            return result;
+        }
     }
 
     // Remove submaximal blocks for each block list including fully contained blocks
@@ -1141,14 +1823,19 @@ OverlapResult OverlapBuilder::overlap(const DNASeq& read, size_t minOverlap, Ove
 
     // Filter out transitive overlap blocks if requested
     if (_irreducible) {
-        IrreducibleBlockListExtractor extractor(_fmi, _rfmi);
+        IrreducibleBlockListExtractor extractor(_fmi, _rfmi, _limits.maxSteps);
 
         // Join the suffix and prefix lists
         std::copy(suffixrev.begin(), suffixrev.end(), std::back_inserter(suffixfwd));
-        result.aborted |= extractor.extract(&suffixfwd, blocks);
+        result.aborted = result.aborted || !extractor.extract(&suffixfwd, blocks);
 
         std::copy(prefixrev.begin(), prefixrev.end(), std::back_inserter(prefixfwd));
-        result.aborted |= extractor.extract(&prefixfwd, blocks);
+        result.aborted = result.aborted || !extractor.extract(&prefixfwd, blocks);
+
+        // The overlaps of an aborted read are incomplete, drop them all
+        if (result.aborted) {
+            blocks->clear();
+        }
     } else {
         std::copy(suffixfwd.begin(), suffixfwd.end(), std::back_inserter(*blocks));
         std::copy(suffixrev.begin(), suffixrev.end(), std::back_inserter(*blocks));
@@ -1166,8 +1853,8 @@ OverlapResult OverlapBuilder::duplicate(const DNASeq& read, OverlapBlockList* bl
     size_t minOverlap = seq.length();
     OverlapBlockFinder finder(_fmi, _rfmi, minOverlap), rfinder(_rfmi, _fmi, minOverlap);
 
-    finder.find(seq, kSuffixPrefixAF, NULL, blocks, &result);
-    rfinder.find(make_dna_complement_copy(seq), kSuffixSuffixAF, NULL, blocks, &result);
+    finder.find(StrandedSeq(seq), kSuffixPrefixAF, NULL, blocks, &result);
+    rfinder.find(StrandedSeq(seq, false, true), kSuffixSuffixAF, NULL, blocks, &result);
 
     return result;
 }
@@ -6,6 +6,8 @@
 
 #include <iostream>
 #include <list>
+#include <string>
+#include <vector>
 
 struct OverlapResult;
 struct OverlapBlock;
@@ -17,14 +19,35 @@ typedef std::list<OverlapBlock> OverlapBlockList;
 //
 class OverlapBuilder {
 public:
-    OverlapBuilder(const FMIndex* fmi, const FMIndex* rfmi, const std::string& prefix="default", bool irreducible=true, bool rc=true) : _fmi(fmi), _rfmi(rfmi), _prefix(prefix), _irreducible(irreducible), _rc(rc) {
+    // Limits on the work spent on a single read, 0 means no limit. A read that
+    // hits one of them is flagged as aborted, and no edge to or from it is output.
+    struct Limits {
+        Limits(size_t maxBlocks=0, size_t maxInterval=0, size_t maxSteps=0) : maxBlocks(maxBlocks), maxInterval(maxInterval), maxSteps(maxSteps) {
+        }
+        size_t maxBlocks;   // overlap blocks found for the read
+        size_t maxInterval; // reads in the interval of a single overlap block
+        size_t maxSteps;    // extension rounds when removing transitive overlaps
+    };
+
+    OverlapBuilder(const FMIndex* fmi, const FMIndex* rfmi, const std::string& prefix="default", bool irreducible=true, bool rc=true, const Limits& limits=Limits()) : _fmi(fmi), _rfmi(rfmi), _prefix(prefix), _irreducible(irreducible), _rc(rc), _limits(limits) {
     }
 
-    bool build(DNASeqReader& reader, size_t minOverlap, std::ostream& output, size_t threads=1, size_t batch=1000, size_t* processed=NULL) const;
-    bool build(const std::string& input, size_t minOverlap, const std::string& output, size_t threads=1, size_t batch=1000, size_t* processed=NULL) const;
+    // With shards > 1 only the reads in the shard-th of shards equal ranges are
+    // processed, the output holds the vertices and edges of those reads.
+    bool build(DNASeqReader& reader, size_t minOverlap, std::ostream& output, size_t threads=1, size_t batch=1000, size_t shard=0, size_t shards=1, size_t* processed=NULL) const;
+    bool build(const std::string& input, size_t minOverlap, const std::string& output, size_t threads=1, size_t batch=1000, size_t shard=0, size_t shards=1, size_t* processed=NULL) const;
+    // Merge the outputs of all the shards, in any order, into a single ASQG. The
+    // shards are checked to be the complete set of one run. The result is identical
+    // to the one built without sharding when the shards ran on a single thread.
+    static bool merge(const std::vector<std::string>& inputs, std::ostream& output);
+    static bool merge(const std::vector<std::string>& inputs, const std::string& output);
+    // The prefix of the files written for a shard
+    static std::string shardPrefix(const std::string& prefix, size_t shard, size_t shards);
 
-    bool rmdup(DNASeqReader& reader, std::ostream& output, std::ostream& duplicates, size_t threads=1, size_t* processed=NULL) const;
-    bool rmdup(const std::string& input, const std::string& output, const std::string& duplicates, size_t threads=1, size_t* processed=NULL) const;
+    // With prefilter the exact duplicates (on either strand) are grouped by hash
+    // first, and only one read of each group is searched in the FM-index
+    bool rmdup(DNASeqReader& reader, std::ostream& output, std::ostream& duplicates, size_t threads=1, size_t* processed=NULL, bool prefilter=true) const;
+    bool rmdup(const std::string& input, const std::string& output, const std::string& duplicates, size_t threads=1, size_t* processed=NULL, bool prefilter=true) const;
     
     OverlapResult overlap(const DNASeq& read, size_t minOverlap, OverlapBlockList* blocks) const;
     OverlapResult duplicate(const DNASeq& read, OverlapBlockList* blocks) const;
@@ -35,6 +58,7 @@ private:
     std::string _prefix;
     bool _irreducible;
     bool _rc; // reverse complement
+    Limits _limits;
 };
 
 #endif // overlap_builder_h_
@@ -0,0 +1,80 @@
+#include "config.h"
+#include "constant.h"
+#include "overlap_builder.h"
+#include "runner.h"
+
+#include <iostream>
+#include <string>
+
+#include <boost/format.hpp>
+
+#include <log4cxx/logger.h>
+
+static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("arcs.OverlapMerge"));
+
+class OverlapMerge : public Runner {
+public:
+    int run(const Properties& options, const Arguments& arguments) {
+        int r = 0;
+
+        if ((r = checkOptions(options, arguments)) != 0) {
+            return r;
+        }
+
+        for (const auto& input : arguments) {
+            LOG4CXX_INFO(logger, boost::format("input: %s") % input);
+        }
+
+        std::string output = options.get<std::string>("prefix", "default") + ASQG_EXT + GZIP_EXT;
+        LOG4CXX_INFO(logger, boost::format("output: %s") % output);
+
+        if (!OverlapBuilder::merge(arguments, output)) {
+            LOG4CXX_ERROR(logger, boost::format("Failed to merge overlaps into %s") % output);
+            r = -1;
+        }
+
+        return r;
+    }
+
+private:
+    OverlapMerge(const std::string& name, const std::string& description, const std::string& shortopts, const option* longopts) : Runner(shortopts, longopts) {
+        RUNNER_INSTALL(name, this, description, kOverlapMerge);
+    }
+    int checkOptions(const Properties& options, const Arguments& arguments) const {
+        if (options.find("help") != options.not_found() || arguments.empty()) {
+            return printHelps();
+        }
+        return 0;
+    }
+    int printHelps() const {
+        std::cout << boost::format(
+                "%s overlap-merge [OPTION] ... SHARDFILE ...\n"
+                "Merge the ASQG files written by overlap --shard=I/N for all the N shards, given in any order\n"
+                "The result is identical to an unsharded overlap run when every shard ran with --threads=1\n"
+                "\n"
+                "      -h, --help                       display this help and exit\n"
+                "\n"
+                "      -p, --prefix=PREFIX              write the overlaps to PREFIX.asqg.gz (default: default)\n"
+                "\n"
+                ) % PACKAGE_NAME << std::endl;
+        return 256;
+    }
+
+    static OverlapMerge _runner;
+};
+
+static const std::string shortopts = "c:s:p:h";
+enum { OPT_HELP = 1 };
+static const option longopts[] = {
+    {"log4cxx",             required_argument,  NULL, 'c'}, 
+    {"ini",                 required_argument,  NULL, 's'}, 
+    {"prefix",              required_argument,  NULL, 'p'}, 
+    {"help",                no_argument,        NULL, 'h'}, 
+    {NULL, 0, NULL, 0}, 
+};
+OverlapMerge OverlapMerge::_runner(
+        "overlap-merge", 
+        "merge the overlaps computed in shards", 
+        shortopts, 
+        longopts
+        );
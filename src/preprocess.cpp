@@ -6,8 +6,10 @@
 #include "quality.h"
 #include "reads.h"
 #include "runner.h"
+#include "sequence_process_framework.h"
 #include "utils.h"
 
+#include <cstdint>
 #include <fstream>
 #include <memory>
 #include <iostream>
@@ -46,14 +48,28 @@ public:
         if (options.find("sample-rate") != options.not_found()) {
             LOG4CXX_INFO(logger, boost::format("sample rate: %f") % options.get<float>("sample-rate"));
         }
+        if (options.find("sample-seed") != options.not_found()) {
+            LOG4CXX_INFO(logger, boost::format("sample seed: %d") % options.get<uint64_t>("sample-seed"));
+        }
         if (options.find("quality-trim") != options.not_found()) {
             LOG4CXX_INFO(logger, boost::format("Quality Trim: %d") % options.get<int>("quality-trim"));
         }
         if (options.find("quality-filter") != options.not_found()) {
             LOG4CXX_INFO(logger, boost::format("Quality Filter: %d") % options.get<int>("quality-filter"));
         }
+        LOG4CXX_INFO(logger, boost::format("Threads: %d") % options.get<size_t>("threads", 1));
 
-        srand(time(NULL));
+        // adapters
+        if (options.find("adapters") != options.not_found()) {
+            std::string file = options.get<std::string>("adapters");
+            size_t seed = options.get<size_t>("adapter-seed", 0), mismatches = options.get<size_t>("adapter-mismatches", 0);
+            _adapters.reset(AdapterScreen::load(file, seed, mismatches));
+            if (!_adapters) {
+                LOG4CXX_ERROR(logger, boost::format("Failed to read the adapters from %s") % file);
+                return -1;
+            }
+            LOG4CXX_INFO(logger, boost::format("Adapters: %s(%d), seed: %d, mismatches: %d, trim: %s") % file % _adapters->size() % seed % mismatches % (options.find("adapter-trim") != options.not_found() ? "yes" : "no"));
+        }
 
         // input
         std::vector<std::string> filelist;
@@ -78,6 +94,10 @@ public:
                 if (stats.numReadsRead > 0) {
                     LOG4CXX_INFO(logger, boost::format("Reads kept:\t%d(%f)") % stats.numReadsKept % ((double)stats.numReadsKept / stats.numReadsRead));
                     LOG4CXX_INFO(logger, boost::format("Reads failed primer screen:\t%d(%e)") % stats.numReadsPrimer % ((double)stats.numReadsPrimer / stats.numReadsRead));
+                    if (_adapters) {
+                        LOG4CXX_INFO(logger, boost::format("Reads failed adapter screen:\t%d(%e)") % stats.numReadsAdapter % ((double)stats.numReadsAdapter / stats.numReadsRead));
+                        LOG4CXX_INFO(logger, boost::format("Reads adapter trimmed:\t%d(%e)") % stats.numReadsAdapterTrimmed % ((double)stats.numReadsAdapterTrimmed / stats.numReadsRead));
+                    }
                 }
                 LOG4CXX_INFO(logger, boost::format("Bases parsed:\t%d") % stats.numBasesRead);
                 if (stats.numBasesRead) {
@@ -98,22 +118,193 @@ public:
 
 private:
     struct Statistics {
-        Statistics() : numReadsRead(0), numReadsKept(0), numBasesRead(0), numBasesKept(0), numReadsPrimer(0), numInvalidPE(0) {
+        Statistics() : numReadsRead(0), numReadsKept(0), numBasesRead(0), numBasesKept(0), numReadsPrimer(0), numReadsAdapter(0), numReadsAdapterTrimmed(0), numInvalidPE(0) {
         }
         size_t numReadsRead;
         size_t numReadsKept;
         size_t numBasesRead;
         size_t numBasesKept;
         size_t numReadsPrimer;
+        size_t numReadsAdapter;
+        size_t numReadsAdapterTrimmed;
         size_t numInvalidPE;
+
+        Statistics& operator+=(const Statistics& stats) {
+            numReadsRead += stats.numReadsRead;
+            numReadsKept += stats.numReadsKept;
+            numBasesRead += stats.numBasesRead;
+            numBasesKept += stats.numBasesKept;
+            numReadsPrimer += stats.numReadsPrimer;
+            numReadsAdapter += stats.numReadsAdapter;
+            numReadsAdapterTrimmed += stats.numReadsAdapterTrimmed;
+            numInvalidPE += stats.numInvalidPE;
+            return *this;
+        }
+    };
+
+    //
+    // ReadItem - A read, or a pair of reads, with its index read and its rank
+    // in the input
+    //
+    struct ReadItem {
+        ReadItem() : idx(0) {
+        }
+        size_t idx;
+        DNASeq read1;
+        DNASeq read2;
+        DNASeq index;
+    };
+
+    //
+    // ReadGenerator - Reads the items, the second read of a pair comes from
+    // reader2, which is reader1 for interleaved pairs
+    //
+    class ReadGenerator {
+    public:
+        ReadGenerator(DNASeqReader* reader1, DNASeqReader* reader2, DNASeqReader* indexer) : _reader1(reader1), _reader2(reader2), _indexer(indexer), _consumed(0) {
+        }
+
+        bool generate(ReadItem& item) {
+            if (_reader1->read(item.read1) && (_reader2 == NULL || _reader2->read(item.read2)) && (_indexer == NULL || _indexer->read(item.index))) {
+                item.idx = _consumed++;
+                return true;
+            }
+            return false;
+        }
+
+        size_t consumed() const {
+            return _consumed;
+        }
+    private:
+        DNASeqReader* _reader1;
+        DNASeqReader* _reader2;
+        DNASeqReader* _indexer;
+        size_t _consumed;
     };
 
-    bool samplePass(const Properties& options) const {
-        if (options.find("sample-rate") == options.not_found()) {
-            return true;
+    //
+    // ReadFilter - Trims and filters the items on one thread, with its own
+    // statistics. Returns true if the item is kept. An item is sampled from
+    // the seed and its rank, whatever the thread processing it.
+    //
+    class ReadFilter {
+    public:
+        ReadFilter(const Preprocess* runner, const Properties& options, bool paired, bool indexed, uint64_t seed) : _runner(runner), _options(options), _paired(paired), _indexed(indexed), _seed(seed), _sampleRate(options.get<float>("sample-rate", 1.0f)), _sampling(options.find("sample-rate") != options.not_found()) {
+            _orientation = options.get("pe-orientation", "fr");
         }
-        float sampleRate = options.get<float>("sample-rate");
-        return rand() / (RAND_MAX + 1.0f) < sampleRate;
+
+        bool process(ReadItem& item) {
+            DNASeq* index = _indexed ? &item.index : NULL;
+            if (!_paired) {
+                return _runner->processRead(_options, item.read1, index, stats) && samplePass(item.idx);
+            }
+
+            DNASeq& read1 = item.read1;
+            DNASeq& read2 = item.read2;
+
+            // If the names of the records are the same, append a /1 and /2 to them
+            if (read1.name == read2.name) {
+                read1.name += "/1";
+                read2.name += "/2";
+            }
+
+            // Ensure the read names are sensible
+            std::string expectedID2 = PairEnd::id(read1.name);
+            std::string expectedID1 = PairEnd::id(read2.name);
+
+            if (expectedID1 != read1.name || expectedID2 != read2.name) {
+                LOG4CXX_WARN(logger, "Pair names do not match (expected format /1,/2 or /A,/B)");
+                LOG4CXX_WARN(logger, boost::format("Read1 name: %s") % read1.name);
+                LOG4CXX_WARN(logger, boost::format("Read2 name: %s") % read2.name);
+                // Statistics
+                stats.numInvalidPE += 2;
+            }
+
+            bool passed1 = _runner->processRead(_options, read1, index, stats);
+            bool passed2 = _runner->processRead(_options, read2, index, stats);
+            if (passed1 && passed2 && samplePass(item.idx)) {
+                if (boost::algorithm::iequals(_orientation, "fr")) {
+                    read2.make_reverse_complement();
+                } else if (boost::algorithm::iequals(_orientation, "rf")) {
+                    read1.make_reverse_complement();
+                }
+                return true;
+            }
+            return false;
+        }
+
+        Statistics stats;
+    private:
+        bool samplePass(size_t idx) const {
+            return !_sampling || uniform(idx) < _sampleRate;
+        }
+        // A number in [0, 1) mixed from the seed and idx by splitmix64
+        float uniform(size_t idx) const {
+            uint64_t z = _seed + (idx + 1) * 0x9e3779b97f4a7c15ULL;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            z ^= z >> 31;
+            return (z >> 40) / (float)(1 << 24);
+        }
+
+        const Preprocess* _runner;
+        const Properties& _options;
+        bool _paired;
+        bool _indexed;
+        std::string _orientation;
+        uint64_t _seed;
+        float _sampleRate;
+        bool _sampling;
+    };
+
+    //
+    // ReadWriter - Writes the kept items in the input order
+    //
+    class ReadWriter {
+    public:
+        ReadWriter(std::ostream& output, bool paired, Statistics& stats) : _output(output), _paired(paired), _stats(stats) {
+        }
+
+        void process(const ReadItem& item, bool kept) {
+            if (kept) {
+                _output << item.read1;
+                // Statistics
+                ++_stats.numReadsKept;
+                _stats.numBasesKept += item.read1.seq.length();
+                if (_paired) {
+                    _output << item.read2;
+                    ++_stats.numReadsKept;
+                    _stats.numBasesKept += item.read2.seq.length();
+                }
+            }
+        }
+    private:
+        std::ostream& _output;
+        bool _paired;
+        Statistics& _stats;
+    };
+
+    // A reader of file, "-" is the standard input. A plain file is parsed on
+    // threads of its own, on top of the workers, otherwise the stream opened
+    // is kept in stream.
+    DNASeqReader* createReader(const std::string& file, size_t threads, std::shared_ptr<std::istream>& stream) const {
+        if (file == "-") {
+            // The reads are taken on another thread than the one writing, a
+            // read of std::cin must not flush std::cout
+            std::cin.tie(NULL);
+            return DNASeqReaderFactory::create(std::cin);
+        }
+        if (threads > 1) {
+            DNASeqReader* reader = DNASeqReaderFactory::create(file, threads);
+            if (reader != NULL) {
+                return reader;
+            }
+        }
+        stream.reset(Utils::ifstream(file));
+        if (stream) {
+            return DNASeqReaderFactory::create(*stream);
+        }
+        return NULL;
     }
 
     int processReads(const Properties& options, const std::vector<std::string>& inputs, std::ostream& output, Statistics& stats) {
@@ -134,15 +325,16 @@ private:
     int processSingleEnds(const Properties& options, const std::vector<std::string>& inputs, std::ostream& output, Statistics& stats) {
         bool withIndex = options.find("with-index") != options.not_found();
         {
-            size_t multiples = 2;
+            size_t multiples = 1;
             if (withIndex) {
                 multiples += 1;
             }
             if (inputs.size() % multiples != 0) {
-                LOG4CXX_ERROR(logger, boost::format("Files in multiples of %d must be given for --pe-mode=1") % multiples % (withIndex ? " and --with-index" : ""));
+                LOG4CXX_ERROR(logger, boost::format("Files in multiples of %d must be given for --pe-mode=0%s") % multiples % (withIndex ? " and --with-index" : ""));
                 return -1;
             }
         }
+        size_t threads = options.get<size_t>("threads", 1);
         size_t i = 0;
         while (i < inputs.size()) {
             std::string index;
@@ -158,29 +350,20 @@ private:
 
             int r = -1;
 
-            std::istream* indexer = NULL;
+            std::shared_ptr<std::istream> stream, indexStream;
+            std::shared_ptr<DNASeqReader> indexer;
             if (!index.empty()) {
-                indexer = &std::cin;
-                if (index != "-") {
-                    indexer = Utils::ifstream(index);
-                }
+                indexer.reset(createReader(index, 1, indexStream));
             }
-            if (index.empty() || indexer != NULL) {
-                if (file1 == "-") {
-                    r = processSingleEnds(options, std::cin, indexer, output, stats);
-                } else {
-                    std::shared_ptr<std::istream> stream(Utils::ifstream(file1));
-                    if (stream) {
-                        r = processSingleEnds(options, *stream, indexer, output, stats);
-                    }
+            if (index.empty() || indexer) {
+                std::shared_ptr<DNASeqReader> reader(createReader(file1, threads, stream));
+                if (reader) {
+                    r = processItems(options, reader.get(), NULL, indexer.get(), output, stats);
                 }
             }
-            if (indexer != &std::cin) {
-                SAFE_DELETE(indexer);
-            }
             if (r != 0) {
                 if (withIndex) {
-                    LOG4CXX_ERROR(logger, boost::format("Failed to process single ends: %s with index: %s") % file1 % (index.empty() ? "out" : "") % index);
+                    LOG4CXX_ERROR(logger, boost::format("Failed to process single ends: %s with index: %s") % file1 % index);
                 } else {
                     LOG4CXX_ERROR(logger, boost::format("Failed to process single ends: %s") % file1);
                 }
@@ -190,31 +373,6 @@ private:
         return 0;
     }
 
-    int processSingleEnds(const Properties& options, std::istream& input, std::istream* index, std::ostream& output, Statistics& stats) {
-        std::shared_ptr<DNASeqReader> reader(DNASeqReaderFactory::create(input));
-        std::shared_ptr<DNASeqReader> indexer;
-        if (index != NULL) {
-            indexer.reset(DNASeqReaderFactory::create(*index));
-        }
-        return processSingleEnds(options, reader.get(), indexer.get(), output, stats);
-    }
-
-    int processSingleEnds(const Properties& options, DNASeqReader* reader, DNASeqReader* indexer, std::ostream& output, Statistics& stats) {
-        if (reader) {
-            DNASeq read, index;
-            while (reader->read(read) && (indexer == NULL || indexer->read(index))) {
-                if (processRead(options, read, (indexer != NULL ? &index : NULL), stats) && samplePass(options)) {
-                    output << read;
-                    // Statistics
-                    ++stats.numReadsKept;
-                    stats.numBasesKept += read.seq.length();
-                }
-            }
-            return 0;
-        }
-        return -1;
-    }
-
     int processPairEnds1(const Properties& options, const std::vector<std::string>& inputs, std::ostream& output, Statistics& stats) {
         bool withIndex = options.find("with-index") != options.not_found();
         {
@@ -223,11 +381,12 @@ private:
                 multiples += 1;
             }
             if (inputs.size() % multiples != 0) {
-                LOG4CXX_ERROR(logger, boost::format("Files in multiples of %d must be given for --pe-mode=1") % multiples % (withIndex ? " and --with-index" : ""));
+                LOG4CXX_ERROR(logger, boost::format("Files in multiples of %d must be given for --pe-mode=1%s") % multiples % (withIndex ? " and --with-index" : ""));
                 return -1;
             }
         }
 
+        size_t threads = options.get<size_t>("threads", 1);
         size_t i = 0;
         while (i < inputs.size()) {
             std::string index;
@@ -244,22 +403,18 @@ private:
 
             int r = -1;
 
-            std::istream* indexer = NULL;
+            std::shared_ptr<std::istream> stream1, stream2, indexStream;
+            std::shared_ptr<DNASeqReader> indexer;
             if (!index.empty()) {
-                indexer = &std::cin;
-                if (index != "-") {
-                    indexer = Utils::ifstream(index);
-                }
+                indexer.reset(createReader(index, 1, indexStream));
             }
-            if (index.empty() || indexer != NULL) {
-                std::shared_ptr<std::istream> stream1(Utils::ifstream(file1)), stream2(Utils::ifstream(file2));
-                if (stream1 && stream2) {
-                    r = processPairEnds(options, *stream1, *stream2, indexer, output, stats);
+            if (index.empty() || indexer) {
+                // Each mate file is parsed on half of the threads
+                std::shared_ptr<DNASeqReader> reader1(createReader(file1, threads / 2, stream1)), reader2(createReader(file2, threads / 2, stream2));
+                if (reader1 && reader2) {
+                    r = processItems(options, reader1.get(), reader2.get(), indexer.get(), output, stats);
                 }
             }
-            if (indexer != &std::cin) {
-                SAFE_DELETE(indexer);
-            }
             if (r != 0) {
                 if (withIndex) {
                     LOG4CXX_ERROR(logger, boost::format("Failed to process pair ends: %s,%s with index: %s") % file1 % file2 % index);
@@ -280,11 +435,12 @@ private:
                 multiples += 1;
             }
             if (inputs.size() % multiples != 0) {
-                LOG4CXX_ERROR(logger, boost::format("Files in multiples of %d must be given for --pe-mode=2") % multiples % (withIndex ? " and --with-index" : ""));
+                LOG4CXX_ERROR(logger, boost::format("Files in multiples of %d must be given for --pe-mode=2%s") % multiples % (withIndex ? " and --with-index" : ""));
                 return -1;
             }
         }
 
+        size_t threads = options.get<size_t>("threads", 1);
         size_t i = 0;
         while (i < inputs.size()) {
             std::string index;
@@ -300,26 +456,18 @@ private:
 
             int r = -1;
 
-            std::istream* indexer = NULL;
+            std::shared_ptr<std::istream> stream, indexStream;
+            std::shared_ptr<DNASeqReader> indexer;
             if (!index.empty()) {
-                indexer = &std::cin;
-                if (index != "-") {
-                    indexer = Utils::ifstream(index);
-                }
+                indexer.reset(createReader(index, 1, indexStream));
             }
-            if (index.empty() || indexer != NULL) {
-                if (file1 == "-") {
-                    r = processPairEnds(options, std::cin, std::cin, indexer, output, stats);
-                } else {
-                    std::shared_ptr<std::istream> stream(Utils::ifstream(file1));
-                    if (stream) {
-                        r = processPairEnds(options, *stream, *stream, indexer, output, stats);
-                    }
+            if (index.empty() || indexer) {
+                // Both mates come from the same reader, which buffers the stream
+                std::shared_ptr<DNASeqReader> reader(createReader(file1, threads, stream));
+                if (reader) {
+                    r = processItems(options, reader.get(), reader.get(), indexer.get(), output, stats);
                 }
             }
-            if (indexer != &std::cin) {
-                SAFE_DELETE(indexer);
-            }
             if (r != 0) {
                 if (withIndex) {
                     LOG4CXX_ERROR(logger, boost::format("Failed to process pair ends: %s with index: %s") % file1 % index);
@@ -332,57 +480,47 @@ private:
         return 0;
     }
 
-    int processPairEnds(const Properties& options, std::istream& input1, std::istream& input2, std::istream* index, std::ostream& output, Statistics& stats) {
-        std::shared_ptr<DNASeqReader> reader1(DNASeqReaderFactory::create(input1));
-        std::shared_ptr<DNASeqReader> reader2(DNASeqReaderFactory::create(input2));
-        std::shared_ptr<DNASeqReader> indexer;
-        if (index != NULL) {
-            indexer.reset(DNASeqReaderFactory::create(*index));
-        }
-        return processPairEnds(options, reader1.get(), reader2.get(), indexer.get(), output, stats);
-    }
-
-    int processPairEnds(const Properties& options, DNASeqReader* reader1, DNASeqReader* reader2, DNASeqReader* indexer, std::ostream& output, Statistics& stats) {
-        if (reader1 != NULL && reader2 != NULL) {
-            std::string orientation = options.get("pe-orientation", "fr");
-
-            DNASeq read1, read2, index;
-            while (reader1->read(read1) && reader2->read(read2) && (indexer == NULL || indexer->read(index))) {
-                // If the names of the records are the same, append a /1 and /2 to them
-                if (read1.name == read2.name) {
-                    read1.name += "/1";
-                    read2.name += "/2";
-                }
-
-                // Ensure the read names are sensible
-                std::string expectedID2 = PairEnd::id(read1.name);
-                std::string expectedID1 = PairEnd::id(read2.name);
+    // Process the reads, or the pairs if reader2 is given, on the threads and
+    // write the kept ones in the input order
+    int processItems(const Properties& options, DNASeqReader* reader1, DNASeqReader* reader2, DNASeqReader* indexer, std::ostream& output, Statistics& stats) const {
+        size_t threads = options.get<size_t>("threads", 1);
+        bool paired = reader2 != NULL, indexed = indexer != NULL;
+        uint64_t seed = options.get<uint64_t>("sample-seed", time(NULL));
+
+        ReadGenerator generator(reader1, reader2, indexer);
+        ReadWriter postproc(output, paired, stats);
+        if (threads <= 1) {
+            ReadFilter proc(this, options, paired, indexed, seed);
+            SequenceProcessFramework::SerialWorker<
+                ReadItem, 
+                bool, 
+                ReadGenerator, 
+                ReadFilter, 
+                ReadWriter
+                > worker("preprocess");
+            worker.run(generator, &proc, &postproc);
+            stats += proc.stats;
+        } else {
+            std::vector<ReadFilter *> proclist(threads);
+            for (size_t i = 0; i < threads; ++i) {
+                proclist[i] = new ReadFilter(this, options, paired, indexed, seed);
+            }
 
-                if (expectedID1 != read1.name || expectedID2 != read2.name) {
-                    LOG4CXX_WARN(logger, "Pair names do not match (expected format /1,/2 or /A,/B)");
-                    LOG4CXX_WARN(logger, boost::format("Read1 name: %s") % read1.name);
-                    LOG4CXX_WARN(logger, boost::format("Read2 name: %s") % read2.name);
-                    // Statistics
-                    stats.numInvalidPE += 2;
-                }
+            SequenceProcessFramework::ParallelWorker<
+                ReadItem, 
+                bool, 
+                ReadGenerator, 
+                ReadFilter, 
+                ReadWriter
+                > worker("preprocess");
+            worker.run(generator, &proclist, &postproc);
 
-                bool passed1 = processRead(options, read1, (indexer != NULL ? &index : NULL), stats);
-                bool passed2 = processRead(options, read2, (indexer != NULL ? &index : NULL), stats);
-                if (passed1 && passed2 && samplePass(options)) {
-                    if (boost::algorithm::iequals(orientation, "fr")) {
-                        read2.make_reverse_complement();
-                    } else if (boost::algorithm::iequals(orientation, "rf")) {
-                        read1.make_reverse_complement();
-                    }
-                    output << read1 << read2;
-                    // Statistics
-                    stats.numReadsKept += 2;
-                    stats.numBasesKept += (read1.seq.length() + read2.seq.length());
-                }
+            for (size_t i = 0; i < threads; ++i) {
+                stats += proclist[i]->stats;
+                delete proclist[i];
             }
-            return 0;
         }
-        return -1;
+        return 0;
     }
 
     bool processRead(const Properties& options, DNASeq& record, DNASeq* index, Statistics& stats) const {
@@ -442,6 +580,22 @@ private:
             }
         }
 
+        // Adapter screen, the adapters are trimmed or the read is discarded
+        if (_adapters) {
+            if (options.find("adapter-trim") != options.not_found()) {
+                size_t length = _adapters->trimLength(record.seq, options.get<size_t>("adapter-min-overlap", 10));
+                if (length < record.seq.length()) {
+                    hardClip(length, record);
+                    // Statistics
+                    ++stats.numReadsAdapterTrimmed;
+                }
+            } else if (_adapters->find(record.seq)) {
+                // Statistics
+                ++stats.numReadsAdapter;
+                return false;
+            }
+        }
+
         // Quality filter
         {
             int qualityFilter = options.get<int>("quality-filter", -1);
@@ -472,44 +626,14 @@ private:
     // Count the number of low quality bases in the read
     size_t countLowQuality(const DNASeq& record) const {
         assert(record.seq.length() == record.quality.length());
-
-        size_t n = 0;
-        for (auto q : record.quality) {
-            int ps = Quality::Phred::fromchar(q);
-            if (ps <= LOW_QUALITY_PHRED_SCORE) {
-                ++n;
-            }
-        }
-        return n;
+        return Quality::countAtMost(record.quality.data(), record.quality.length(), LOW_QUALITY_PHRED_SCORE);
     }
 
     // Perform a soft-clipping of the sequence by removing low quality bases from the
     // 3' end using Heng Li's algorithm from bwa
     void softClip(int qualityTrim, DNASeq& record) const {
         assert(record.seq.length() == record.quality.length());
-
-        size_t i = record.seq.length();
-        int terminalScore = Quality::Phred::fromchar(record.quality[i - 1]);
-        // Only perform soft-clipping if the last base has qual less than qualTrim
-        if (terminalScore < qualityTrim) {
-            size_t endpoint = 0; // not inclusive
-            int max = 0;
-
-            int subSum = 0;
-            while (i > 0) {
-                int ps = Quality::Phred::fromchar(record.quality[i - 1]);
-                int score = qualityTrim - ps;
-                subSum += score;
-                if (subSum > max) {
-                    max = subSum;
-                    endpoint = i;
-                }
-                --i;
-            }
-
-            // Clip the read
-            hardClip(endpoint, record);
-        }
+        hardClip(Quality::trimLength(record.quality.data(), record.quality.length(), qualityTrim), record);
     }
 
     // Perform a hard-clipping
@@ -545,6 +669,8 @@ private:
                 "\n"
                 "Input/Output options:\n"
                 "      -o, --out=FILE                   write the reads to FILE (default: stdout)\n"
+                "      -t, --threads=NUM                use NUM threads (default: 1), plain input files are parsed on NUM\n"
+                "                                       more threads, split between the two files with --pe-mode=1\n"
                 "          --pe-mode=INT                0 - do not treat reads as paired (default)\n"
                 "                                       1 - reads are paired with the first read in READS1 and the second\n"
                 "                                       read in READS2. The paired reads will be interleaved in the output file\n"
@@ -567,24 +693,35 @@ private:
                 "          --hard-clip=INT              clip all reads to be length INT. In most cases it is better to use\n"
                 "                                       the soft clip (quality-trim) option.\n"
                 "          --sample-rate=FLOAT          randomly sample reads or pairs with acceptance probability FLOAT.\n"
+                "          --sample-seed=INT            seed of the sampling, the same seed keeps the same reads for any number\n"
+                "                                       of threads. Default: the current time\n"
                 "\n"
                 "Adapter/Primer checks:\n"
                 "          --no-primer-check            disable the default check for primer sequences\n"
+                "          --adapters=FILE              discard the reads containing any of the adapters in the fasta FILE\n"
+                "          --adapter-seed=INT           find the adapters from exact seeds of INT bases anywhere in them, then\n"
+                "                                       compare the whole adapters. Default: 0, find the whole adapters exactly\n"
+                "          --adapter-mismatches=INT     allow INT mismatches with the adapters found from a seed. Default: 0\n"
+                "          --adapter-trim               trim the reads from the first adapter instead of discarding them\n"
+                "          --adapter-min-overlap=INT    also trim a prefix of an adapter of at least INT bases at the 3' end. Default: 10\n"
                 "\n"
                 ) % PACKAGE_NAME << std::endl;
 
         return 256;
     }
 
+    std::shared_ptr<AdapterScreen> _adapters;
+
     static Preprocess _runner;
 };
 
-static const std::string shortopts = "c:s:o:p:q:f:m:h";
-enum { OPT_HELP = 1, OPT_PE_MODE, OPT_WITH_IDX, OPT_PE_ORIENTATION, OPT_PHRED64, OPT_HARD_CLIP, OPT_SAMPLE_RATE, OPT_NO_PRIMER_CHECK };
+static const std::string shortopts = "c:s:o:p:q:f:m:t:h";
+enum { OPT_HELP = 1, OPT_PE_MODE, OPT_WITH_IDX, OPT_PE_ORIENTATION, OPT_PHRED64, OPT_HARD_CLIP, OPT_SAMPLE_RATE, OPT_SAMPLE_SEED, OPT_NO_PRIMER_CHECK, OPT_ADAPTERS, OPT_ADAPTER_SEED, OPT_ADAPTER_MISMATCHES, OPT_ADAPTER_TRIM, OPT_ADAPTER_MIN_OVERLAP };
 static const option longopts[] = {
     {"log4cxx",             required_argument,  NULL, 'c'}, 
     {"ini",                 required_argument,  NULL, 's'}, 
     {"out",                 required_argument,  NULL, 'o'}, 
+    {"threads",             required_argument,  NULL, 't'}, 
     {"pe-mode",             required_argument,  NULL, OPT_PE_MODE}, 
     {"pe-orientation",      required_argument,  NULL, OPT_PE_ORIENTATION}, 
     {"with-index",          no_argument,        NULL, OPT_WITH_IDX}, 
@@ -594,7 +731,13 @@ static const option longopts[] = {
     {"min-length",          required_argument,  NULL, 'm'}, 
     {"hard-clip",           required_argument,  NULL, OPT_HARD_CLIP}, 
     {"sample-rate",         required_argument,  NULL, OPT_SAMPLE_RATE}, 
+    {"sample-seed",         required_argument,  NULL, OPT_SAMPLE_SEED}, 
     {"no-primer-check",     no_argument,        NULL, OPT_NO_PRIMER_CHECK}, 
+    {"adapters",            required_argument,  NULL, OPT_ADAPTERS}, 
+    {"adapter-seed",        required_argument,  NULL, OPT_ADAPTER_SEED}, 
+    {"adapter-mismatches",  required_argument,  NULL, OPT_ADAPTER_MISMATCHES}, 
+    {"adapter-trim",        no_argument,        NULL, OPT_ADAPTER_TRIM}, 
+    {"adapter-min-overlap", required_argument,  NULL, OPT_ADAPTER_MIN_OVERLAP}, 
     {"help",                no_argument,        NULL, 'h'}, 
     {NULL, 0, NULL, 0}, 
 };
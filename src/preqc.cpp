@@ -77,14 +77,6 @@ public:
 private:
     class QualityStatistics {
     public:
-        struct Statistics {
-            Statistics() : qualitysum(0), q30num(0), count(0) {
-            }
-            size_t qualitysum;
-            size_t q30num;
-            size_t count;
-        };
-
         QualityStatistics(double sampleRate) : _sampleRate(sampleRate) {
         }
 
@@ -113,39 +105,30 @@ private:
 
         int stats(DNASeqReader* reader, JSONWriter* writer) const {
             if (reader) {
-                std::vector<Statistics> bases;
+                Quality::PositionStats bases;
 
                 DNASeq read;
                 while (reader->read(read)) {
                     if ((double)rand() / RAND_MAX < _sampleRate && read.seq.length() == read.quality.length()) {
-                        size_t l = read.seq.length();
-                        if (l > bases.size()) {
-                            bases.resize(l);
-                        }
-                        for (size_t i = 0; i < l; ++i) {
-                            Statistics& base = bases[i];
-                            int q = Quality::Phred::fromchar(read.quality[i]);
-                            ++base.count;
-                            base.qualitysum += q;
-                            base.q30num += (q >= 30) ? 1 : 0;
-                        }
+                        bases.add(read.quality.data(), read.quality.length());
                     }
                 }
+                bases.flush();
 
                 writer->String("QualityScores");
                 writer->StartObject();
                 {
                     writer->String("mean_quality");
                     writer->StartArray();
-                    for (const auto& base : bases) {
-                        writer->Double((double)base.qualitysum / base.count);
+                    for (size_t i = 0; i < bases.length(); ++i) {
+                        writer->Double((double)bases.sum(i) / bases.count(i));
                     }
                     writer->EndArray();
 
                     writer->String("fraction_q30");
                     writer->StartArray();
-                    for (const auto& base : bases) {
-                        writer->Double((double)base.q30num / base.count);
+                    for (size_t i = 0; i < bases.length(); ++i) {
+                        writer->Double((double)bases.q30(i) / bases.count(i));
                     }
                     writer->EndArray();
                 }
@@ -167,7 +150,12 @@ private:
 
         int estimate(const std::string& prefix, JSONWriter* writer) const {
             int r = 0;
-            if ((r = estimateSize(NULL, writer)) != 0) {
+            FMIndex fmi;
+            if (!FMIndex::load(prefix + BWT_EXT, fmi)) {
+                LOG4CXX_ERROR(logger, boost::format("Failed to load FMIndex from %s") % prefix);
+                return -1;
+            }
+            if ((r = estimateSize(&fmi, writer)) != 0) {
                 return r;
             }
             return r;
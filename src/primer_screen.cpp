@@ -8,6 +8,192 @@
 // that match a database of primer sequences
 //
 #include "primer_screen.h"
+#include "kmer.h"
+#include "kseq.h"
+
+#include <algorithm>
+#include <deque>
+
+#include <boost/algorithm/string.hpp>
+
+//
+// AdapterScreen
+//
+AdapterScreen::AdapterScreen(const std::vector<std::string>& adapters, size_t seed, size_t mismatches) : _seed(seed), _mismatches(mismatches), _maxLength(0) {
+    for (const auto& adapter : adapters) {
+        if (!adapter.empty()) {
+            _adapters.push_back(adapter);
+        }
+    }
+
+    _states.emplace_back(0);
+    for (uint32_t i = 0; i < _adapters.size(); ++i) {
+        size_t length = _adapters[i].length();
+        _maxLength = std::max(_maxLength, length);
+        if (seed == 0 || seed >= length) {
+            insert(i, 0, length, true);
+        } else {
+            // The bases after the last seed are kept for within
+            for (uint32_t j = 0; j < length; ++j) {
+                insert(i, j, std::min(seed, length - j), j + seed <= length);
+            }
+        }
+    }
+    build();
+}
+
+AdapterScreen* AdapterScreen::load(const std::string& file, size_t seed, size_t mismatches) {
+    DNASeqList sequences;
+    if (!ReadDNASequences(file, sequences)) {
+        return NULL;
+    }
+    std::vector<std::string> adapters;
+    for (const auto& seq : sequences) {
+        adapters.push_back(boost::algorithm::to_upper_copy(seq.seq));
+    }
+    return new AdapterScreen(adapters, seed, mismatches);
+}
+
+void AdapterScreen::insert(uint32_t adapter, uint32_t offset, size_t length, bool output) {
+    const std::string& seq = _adapters[adapter];
+    int32_t s = kRoot;
+    for (size_t i = 0; i < length; ++i) {
+        // A seed with a base other than ACGT can not be found
+        int c = Kmer::code(seq[offset + i]);
+        if (c < 0) {
+            return;
+        }
+        if (_states[s].next[c] < 0) {
+            _states[s].next[c] = _states.size();
+            _states.emplace_back(_states[s].depth + 1);
+        }
+        s = _states[s].next[c];
+        if (offset == 0) {
+            _states[s].prefix = true;
+        }
+    }
+    if (output) {
+        _states[s].outputs.push_back({adapter, offset});
+    }
+}
+
+void AdapterScreen::build() {
+    // Breadth first, the states of a smaller depth are complete before their
+    // transitions are followed
+    std::deque<int32_t> queue;
+    for (int c = 0; c < 4; ++c) {
+        int32_t& t = _states[kRoot].next[c];
+        if (t < 0) {
+            t = kRoot;
+        } else {
+            queue.push_back(t);
+        }
+    }
+    while (!queue.empty()) {
+        int32_t s = queue.front();
+        queue.pop_front();
+        for (int c = 0; c < 4; ++c) {
+            int32_t t = _states[s].next[c], f = _states[_states[s].fail].next[c];
+            if (t < 0) {
+                _states[s].next[c] = f;
+            } else {
+                _states[t].fail = f;
+                _states[t].dict = _states[f].outputs.empty() ? _states[f].dict : f;
+                queue.push_back(t);
+            }
+        }
+    }
+}
+
+bool AdapterScreen::search(const std::string& seq, Hit* hit, int32_t* last) const {
+    bool found = false;
+    int32_t s = kRoot;
+    for (size_t i = 0; i < seq.length(); ++i) {
+        // No adapter found later can start before the one found
+        if (found && last == NULL && (int64_t)(i + 1) - (int64_t)_maxLength > hit->pos) {
+            break;
+        }
+        int c = Kmer::code(seq[i]);
+        s = c < 0 ? kRoot : _states[s].next[c];
+        for (int32_t t = _states[s].outputs.empty() ? _states[s].dict : s; t >= 0; t = _states[t].dict) {
+            for (const auto& o : _states[t].outputs) {
+                Hit h;
+                if (verify(seq, i, o, &h) && (!found || h.pos < hit->pos)) {
+                    *hit = h;
+                    found = true;
+                }
+            }
+        }
+    }
+    if (last != NULL) {
+        *last = s;
+    }
+    return found;
+}
+
+bool AdapterScreen::verify(const std::string& seq, size_t i, const Output& o, Hit* hit) const {
+    const std::string& adapter = _adapters[o.adapter];
+    size_t seed = _seed == 0 ? adapter.length() : std::min(_seed, adapter.length());
+    int64_t pos = (int64_t)(i + 1) - (int64_t)(seed + o.offset);
+    if (seed == adapter.length()) {
+        *hit = Hit();
+        hit->adapter = o.adapter;
+        hit->pos = pos;
+        return true;
+    }
+
+    int64_t first = std::max(-pos, (int64_t)0), last = std::min((int64_t)adapter.length(), (int64_t)seq.length() - pos);
+    size_t mismatches = 0;
+    for (int64_t j = first; j < last; ++j) {
+        if (adapter[j] != seq[pos + j] && ++mismatches > _mismatches) {
+            return false;
+        }
+    }
+    hit->adapter = o.adapter;
+    hit->pos = pos;
+    hit->mismatches = mismatches;
+    return true;
+}
+
+bool AdapterScreen::find(const std::string& seq, Hit* hit) const {
+    Hit h;
+    return search(seq, hit != NULL ? hit : &h, NULL);
+}
+
+size_t AdapterScreen::trimLength(const std::string& seq, size_t minOverlap) const {
+    Hit hit;
+    int32_t s;
+    size_t length = seq.length();
+    if (search(seq, &hit, &s)) {
+        length = std::max(hit.pos, (int64_t)0);
+    }
+    // The last state is the longest suffix of seq in the automaton, the
+    // shorter ones follow the failures
+    for (; s != kRoot && _states[s].depth >= minOverlap; s = _states[s].fail) {
+        if (_states[s].prefix) {
+            length = std::min(length, seq.length() - _states[s].depth);
+            break;
+        }
+    }
+    return length;
+}
+
+bool AdapterScreen::within(const char* s, size_t n) const {
+    // Only the transitions to a deeper state stay in the trie
+    int32_t t = kRoot;
+    for (size_t i = 0; i < n; ++i) {
+        int c = Kmer::code(s[i]);
+        if (c < 0) {
+            return false;
+        }
+        int32_t u = _states[t].next[c];
+        if (_states[u].depth != _states[t].depth + 1) {
+            return false;
+        }
+        t = u;
+    }
+    return true;
+}
 
 // Hardcoded primer sequences that we wish to filter against
 
@@ -17,24 +203,17 @@
 #define ILLUMINA_SANGER_PCR_FREE_A "AATGATACGGCGACCACCGAGATCTACA"
 #define ILLUMINA_SANGER_PCR_FREE_B "GATCGGAAGAGCGGTTCAGCAGGAATGC"
 
-PrimerScreen::PrimerScreen() {
-    _db = {ILLUMINA_SANGER_PCR_FREE_A, ILLUMINA_SANGER_PCR_FREE_B};
+// For now we only check if the first 14
+// bases of seq is a perfect match to any sequence in the db
+// This is sufficient to get rid of the vast majority of the primer
+// contamination
+static const size_t check_size = 14;
+
+PrimerScreen::PrimerScreen() : _db({ILLUMINA_SANGER_PCR_FREE_A, ILLUMINA_SANGER_PCR_FREE_B}, check_size) {
 }
 
 // Check seq against the primer database
 bool PrimerScreen::containsPrimer(const std::string& seq) {
     static PrimerScreen screener; // initializes singleton object if necessary
-    
-    // For now we only check if the first 14
-    // bases of seq is a perfect match to any sequence in the db
-    // This is sufficient to get rid of the vast majority of the primer
-    // contamination
-    const size_t check_size = 14;
-    std::string check = seq.substr(0, check_size);
-    for (const auto& item : screener._db) {
-        if (item.find(check) != std::string::npos) {
-            return true;
-        }
-    }
-    return false;
+    return screener._db.within(seq.data(), std::min(seq.length(), check_size));
 }
@@ -10,9 +10,84 @@
 #ifndef primer_screen_h_
 #define primer_screen_h_
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
+//
+// AdapterScreen - Finds a set of adapters in the reads with an Aho-Corasick
+// automaton, in one pass over each read whatever the number of adapters.
+//
+// The automaton holds a seed of the adapters at each of their offsets. A
+// seed found in a read places the adapter, which is then compared with the
+// read where they overlap, allowing some mismatches. With a seed of 0 the
+// adapters are found whole and exactly.
+//
+class AdapterScreen {
+public:
+    struct Hit {
+        Hit() : adapter(0), pos(0), mismatches(0) {
+        }
+        size_t adapter;     // index of the adapter
+        int64_t pos;        // where the adapter starts, < 0 if before the read
+        size_t mismatches;
+    };
+
+    AdapterScreen(const std::vector<std::string>& adapters, size_t seed=0, size_t mismatches=0);
+
+    // The adapters of a FASTA/FASTQ file, NULL if it can not be read
+    static AdapterScreen* load(const std::string& file, size_t seed=0, size_t mismatches=0);
+
+    size_t size() const {
+        return _adapters.size();
+    }
+    const std::string& adapter(size_t i) const {
+        return _adapters[i];
+    }
+
+    // Find the adapter starting first in seq, return false if there is none
+    bool find(const std::string& seq, Hit* hit=NULL) const;
+    // The length of seq before the first adapter, or before a prefix of at
+    // least minOverlap bases of an adapter at its end
+    size_t trimLength(const std::string& seq, size_t minOverlap) const;
+    // Return true if the n bases of s occur in an adapter, n <= seed
+    bool within(const char* s, size_t n) const;
+private:
+    static const int32_t kRoot = 0;
+
+    // A seed ending at a state
+    struct Output {
+        uint32_t adapter;
+        uint32_t offset;
+    };
+    struct State {
+        State(uint32_t d) : depth(d), fail(kRoot), dict(-1), prefix(false) {
+            next[0] = next[1] = next[2] = next[3] = -1;
+        }
+        int32_t next[4];    // complete transitions once built
+        uint32_t depth;
+        int32_t fail;       // the longest proper suffix in the automaton
+        int32_t dict;       // the longest proper suffix with outputs, -1 if none
+        bool prefix;        // a prefix of an adapter
+        std::vector<Output> outputs;
+    };
+
+    void insert(uint32_t adapter, uint32_t offset, size_t length, bool output);
+    void build();
+    // The first adapter in seq, scanning to the end and keeping the last
+    // state in last if it is given
+    bool search(const std::string& seq, Hit* hit, int32_t* last) const;
+    // Place the adapter of the seed o ending at i in seq and count the
+    // mismatches where they overlap
+    bool verify(const std::string& seq, size_t i, const Output& o, Hit* hit) const;
+
+    std::vector<std::string> _adapters;
+    std::vector<State> _states;
+    size_t _seed;
+    size_t _mismatches;
+    size_t _maxLength;
+};
+
 class PrimerScreen {
 public:
     // Return true if the sequence fails the primer check
@@ -20,7 +95,7 @@ public:
 
 private:
     PrimerScreen(); 
-    std::vector<std::string> _db;
+    AdapterScreen _db;
 };
 
 #endif // primer_screen_h_
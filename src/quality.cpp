@@ -0,0 +1,152 @@
+#include "quality.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+
+static inline __m128i max_epi32(__m128i a, __m128i b) {
+    __m128i gt = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+}
+#endif
+
+namespace Quality {
+    size_t countAtMost(const char* quality, size_t n, int phred) {
+        int limit = phred + 33;
+        if (limit < 0) {
+            return 0;
+        } else if (limit >= 255) {
+            return n;
+        }
+
+        size_t count = 0, i = 0;
+#ifdef __SSE2__
+        // c <= limit if min(c, limit) == c, unsigned
+        const __m128i l = _mm_set1_epi8((char)limit);
+        for (; i + 16 <= n; i += 16) {
+            __m128i c = _mm_loadu_si128((const __m128i*)(quality + i));
+            count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(c, l), c)));
+        }
+#endif
+        for (; i < n; ++i) {
+            count += (uint8_t)quality[i] <= limit ? 1 : 0;
+        }
+        return count;
+    }
+
+    size_t trimLength(const char* quality, size_t n, int threshold) {
+        if (n == 0 || (uint8_t)quality[n - 1] - 33 >= threshold) {
+            return n;
+        }
+
+        // The read is scanned from its end, adding threshold - q to sum. The
+        // length kept is where sum first reaches its maximum.
+        int base = threshold + 33, sum = 0, best = 0;
+        size_t endpoint = 0, i = n;
+#ifdef __SSE2__
+        // The sums of 4 scores at once with a prefix sum in the register.
+        // Only the block holding the maximum is scanned again.
+        const __m128i b = _mm_set1_epi32(base), zero = _mm_setzero_si128();
+        size_t bestBlock = 0;
+        int bestBlockSum = 0;
+        for (; i >= 4; i -= 4) {
+            int32_t w;
+            memcpy(&w, quality + i - 4, sizeof(w));
+            __m128i c = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(w), zero), zero);
+            // In the order of the scan: q[i - 1], q[i - 2], q[i - 3], q[i - 4]
+            c = _mm_shuffle_epi32(c, _MM_SHUFFLE(0, 1, 2, 3));
+            __m128i d = _mm_sub_epi32(b, c);
+            d = _mm_add_epi32(d, _mm_slli_si128(d, 4));
+            d = _mm_add_epi32(d, _mm_slli_si128(d, 8));
+            d = _mm_add_epi32(d, _mm_set1_epi32(sum));
+
+            __m128i m = max_epi32(d, _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2)));
+            m = max_epi32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+            int blockMax = _mm_cvtsi128_si32(m);
+            if (blockMax > best) {
+                best = blockMax;
+                bestBlock = i;
+                bestBlockSum = sum;
+            }
+            sum = _mm_cvtsi128_si32(_mm_shuffle_epi32(d, _MM_SHUFFLE(3, 3, 3, 3)));
+        }
+        if (bestBlock > 0) {
+            int s = bestBlockSum;
+            for (size_t j = bestBlock; j + 4 > bestBlock; --j) {
+                s += base - (uint8_t)quality[j - 1];
+                if (s == best) {
+                    endpoint = j;
+                    break;
+                }
+            }
+        }
+#endif
+        for (; i > 0; --i) {
+            sum += base - (uint8_t)quality[i - 1];
+            if (sum > best) {
+                best = sum;
+                endpoint = i;
+            }
+        }
+        return endpoint;
+    }
+
+    //
+    // PositionStats
+    //
+    void PositionStats::add(const char* quality, size_t n) {
+        if (_pending == kPending) {
+            flush();
+        }
+        if (_ends.size() < n + 1) {
+            _counts.resize(n);
+            _sums.resize(n);
+            _q30s.resize(n);
+            _ends.resize(n + 1);
+            _pendingSums.resize(n);
+            _pendingQ30s.resize(n);
+        }
+        ++_ends[n];
+        ++_pending;
+
+        size_t i = 0;
+#ifdef __SSE2__
+        // Widened to 16 bits after the subtraction, which saturates at 0
+        const __m128i bang = _mm_set1_epi8(33), q30 = _mm_set1_epi8(33 + 30), ones = _mm_set1_epi8(1), zero = _mm_setzero_si128();
+        for (; i + 16 <= n; i += 16) {
+            __m128i c = _mm_loadu_si128((const __m128i*)(quality + i));
+            __m128i q = _mm_subs_epu8(c, bang);
+            __m128i h = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(c, q30), c), ones);
+
+            __m128i* s = (__m128i*)&_pendingSums[i];
+            _mm_storeu_si128(s, _mm_add_epi16(_mm_loadu_si128(s), _mm_unpacklo_epi8(q, zero)));
+            _mm_storeu_si128(s + 1, _mm_add_epi16(_mm_loadu_si128(s + 1), _mm_unpackhi_epi8(q, zero)));
+            __m128i* t = (__m128i*)&_pendingQ30s[i];
+            _mm_storeu_si128(t, _mm_add_epi16(_mm_loadu_si128(t), _mm_unpacklo_epi8(h, zero)));
+            _mm_storeu_si128(t + 1, _mm_add_epi16(_mm_loadu_si128(t + 1), _mm_unpackhi_epi8(h, zero)));
+        }
+#endif
+        for (; i < n; ++i) {
+            uint8_t c = quality[i];
+            _pendingSums[i] += c > 33 ? c - 33 : 0;
+            _pendingQ30s[i] += c >= 33 + 30 ? 1 : 0;
+        }
+    }
+
+    void PositionStats::flush() {
+        // A read of length l covers the positions below l
+        uint64_t covering = 0;
+        for (size_t i = _sums.size(); i > 0; --i) {
+            covering += _ends[i];
+            _counts[i - 1] += covering;
+            _sums[i - 1] += _pendingSums[i - 1];
+            _q30s[i - 1] += _pendingQ30s[i - 1];
+        }
+        std::fill(_ends.begin(), _ends.end(), 0);
+        std::fill(_pendingSums.begin(), _pendingSums.end(), 0);
+        std::fill(_pendingQ30s.begin(), _pendingQ30s.end(), 0);
+        _pending = 0;
+    }
+};
@@ -3,6 +3,8 @@
 
 #include <cassert>
 #include <cmath>
+#include <cstdint>
+#include <vector>
 
 //
 // Quality - functions for manipulating quality values
@@ -39,6 +41,63 @@ namespace Quality {
             return (int)(std::round(-10.0f * std::log10(p)));
         }
     };
+
+    //
+    // Kernels over n phred33 quality characters, vectorized with SSE2 on
+    // x86. Characters below '!' count as negative scores.
+    //
+
+    // The number of scores of at most phred
+    size_t countAtMost(const char* quality, size_t n, int phred);
+
+    // The length to keep with Heng Li's BWA trim, argmax_x{\sum_{i=x+1}^n(threshold-q_i)}
+    // or n if the last score is at least threshold
+    size_t trimLength(const char* quality, size_t n, int threshold);
+
+    //
+    // PositionStats - The sum of the scores and the number of Q30 scores at
+    // each position of many reads, characters below '!' scoring 0. The reads
+    // are added to 16 bit counters which are folded into the totals every 256
+    // reads.
+    //
+    class PositionStats {
+    public:
+        PositionStats() : _pending(0) {
+        }
+
+        void add(const char* quality, size_t n);
+        // Fold the pending reads into the totals, before reading them
+        void flush();
+
+        // The length of the longest read
+        size_t length() const {
+            return _sums.size();
+        }
+        // The number of reads covering position i
+        uint64_t count(size_t i) const {
+            assert(_pending == 0);
+            return _counts[i];
+        }
+        uint64_t sum(size_t i) const {
+            assert(_pending == 0);
+            return _sums[i];
+        }
+        uint64_t q30(size_t i) const {
+            assert(_pending == 0);
+            return _q30s[i];
+        }
+    private:
+        static const size_t kPending = 256;
+
+        std::vector<uint64_t> _counts;
+        std::vector<uint64_t> _sums;
+        std::vector<uint64_t> _q30s;
+        // For the pending reads
+        std::vector<uint16_t> _ends; // the number of reads of each length
+        std::vector<uint16_t> _pendingSums;
+        std::vector<uint16_t> _pendingQ30s;
+        size_t _pending;
+    };
 };
 
 #endif // quality_h_
@@ -3,6 +3,8 @@
 #include "fmindex.h"
 #include "overlap_builder.h"
 #include "runner.h"
+#include "utils.h"
+#include "worker_stats.h"
 
 #include <iostream>
 #include <memory>
@@ -35,10 +37,20 @@ public:
         }
         LOG4CXX_INFO(logger, boost::format("output: %s") % output);
 
+        if (options.find("intermediate-codec") != options.not_found()) {
+            std::string codec = options.get<std::string>("intermediate-codec");
+            if (!Utils::intermediateCodec(codec)) {
+                LOG4CXX_ERROR(logger, boost::format("Unsupported codec %s for the intermediate files, expected one of %s") % codec % Utils::intermediateCodecs());
+                return -1;
+            }
+        }
+
+        WorkerStats::sampleInterval(options.get<double>("stats-interval", 0));
+
         FMIndex fmi, rfmi;
         if (FMIndex::load(output + BWT_EXT, fmi) && FMIndex::load(output + RBWT_EXT, rfmi)) {
             OverlapBuilder builder(&fmi, &rfmi, output);
-            if (!builder.rmdup(input, output + RMDUP_EXT + ".fa", output + RMDUP_EXT + ".dups.fa")) {
+            if (!builder.rmdup(input, output + RMDUP_EXT + ".fa", output + RMDUP_EXT + ".dups.fa", options.get<size_t>("threads", 1), NULL, options.find("no-prefilter") == options.not_found())) {
                 LOG4CXX_ERROR(logger, boost::format("Failed to remove duplicates from reads %s") % input);
                 r = -1;
             }
@@ -47,6 +59,14 @@ public:
             r = -1;
         }
 
+        if (r == 0 && options.find("stats") != options.not_found()) {
+            std::string statsfile = options.get<std::string>("stats");
+            if (!WorkerStats::write(statsfile)) {
+                LOG4CXX_ERROR(logger, boost::format("Failed to write stats to %s") % statsfile);
+                r = -1;
+            }
+        }
+
         return r;
     }
 
@@ -70,8 +90,12 @@ private:
                 "      -t, --threads=N                  use N threads (default: 1)\n"
                 "      -d, --sample-rate=N              sample the symbol counts every N symbols in the FM-index. Higher values use significantly\n"
                 "                                       less memory at the cost of higher runtime. This value must be a power of 2 (default: 128)\n"
+                "          --no-prefilter               search every read in the FM-index, without grouping the exact duplicates first\n"
+                "          --intermediate-codec=NAME    compress the intermediate files with NAME, one of %s (default: %s)\n"
+                "          --stats=FILE                 write the throughput and latency counters of the workers to FILE as JSON\n"
+                "          --stats-interval=SEC         log the counters every SEC seconds while running (default: 0, never)\n"
                 "\n"
-                ) % PACKAGE_NAME << std::endl;
+                ) % PACKAGE_NAME % Utils::intermediateCodecs() % Utils::intermediateCodec() << std::endl;
         return 256;
     }
 
@@ -79,13 +103,17 @@ private:
 };
 
 static const std::string shortopts = "c:s:t:p:d:h";
-enum { OPT_HELP = 1 };
+enum { OPT_HELP = 1, OPT_NO_PREFILTER, OPT_INTERMEDIATE_CODEC, OPT_STATS, OPT_STATS_INTERVAL };
 static const option longopts[] = {
     {"log4cxx",             required_argument,  NULL, 'c'}, 
     {"ini",                 required_argument,  NULL, 's'}, 
     {"prefix",              required_argument,  NULL, 'p'}, 
     {"threads",             required_argument,  NULL, 't'}, 
     {"sample-rate",         required_argument,  NULL, 'd'}, 
+    {"no-prefilter",        no_argument,        NULL, OPT_NO_PREFILTER}, 
+    {"intermediate-codec",  required_argument,  NULL, OPT_INTERMEDIATE_CODEC}, 
+    {"stats",               required_argument,  NULL, OPT_STATS}, 
+    {"stats-interval",      required_argument,  NULL, OPT_STATS_INTERVAL}, 
     {"help",                no_argument,        NULL, 'h'}, 
     {NULL, 0, NULL, 0}, 
 };
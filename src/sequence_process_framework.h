@@ -3,14 +3,21 @@
 
 #include "config.h"
 #include "kseq.h"
+#include "thread_pool.h"
+#include "worker_stats.h"
 
-#ifdef HAVE_OMP_H
-#include <omp.h>
-#endif
-
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include <boost/format.hpp>
@@ -32,15 +39,22 @@ namespace SequenceProcessFramework {
     };
 
     // Genereic class to generate work items using a seq reader
+    // The first start reads are skipped, the index of an item is its
+    // rank in the reader.
     template <class Input>
     class SequenceWorkItemGenerator {
     public:
-        SequenceWorkItemGenerator(DNASeqReader& reader) : _reader(reader), _consumed(0) {
+        SequenceWorkItemGenerator(DNASeqReader& reader, size_t start=0) : _reader(reader), _start(start), _skipped(0), _consumed(0) {
         }
 
         bool generate(SequenceWorkItem& item) {
+            for (; _skipped < _start; ++_skipped) {
+                if (!_reader.read(item.read)) {
+                    return false;
+                }
+            }
             if (_reader.read(item.read)) {
-                item.idx = _consumed;
+                item.idx = _start + _consumed;
                 ++_consumed;
                 return true;
             }
@@ -52,6 +66,8 @@ namespace SequenceProcessFramework {
         }
     private:
         DNASeqReader& _reader;
+        size_t _start;
+        size_t _skipped;
         size_t _consumed;
     };
 
@@ -85,17 +101,35 @@ namespace SequenceProcessFramework {
     template <class Input, class Output, class Generator, class Processor, class PostProcessor>
     class SerialWorker {
     public:
+        SerialWorker(const std::string& name="worker") : _name(name) {
+        }
+
         size_t run(Generator& generator, Processor* proc, PostProcessor* postproc, size_t n = -1) {
+            typedef WorkerStats::Clock Clock;
             Input workItem;
 
+            WorkerStats stats(_name, 1);
+            stats.start();
+
+            Clock::time_point t0 = Clock::now();
             while (generator.consumed() < n && generator.generate(workItem)) {
+                Clock::time_point t1 = Clock::now();
                 Output output = proc->process(workItem);
+                Clock::time_point t2 = Clock::now();
                 if (postproc != NULL) {
                     postproc->process(workItem, output);
                 }
+                Clock::time_point t3 = Clock::now();
+
+                stats.generated(t1 - t0, 1);
+                stats.processed(0, t2 - t1, Clock::duration(0), 1);
+                stats.postprocessed(t3 - t2, 1);
+                stats.latency(t3 - t0);
+                t0 = t3;
             }
             
             LOG4CXX_INFO(logger, boost::format("processed %d sequences") % generator.consumed());
+            stats.stop();
 
             return generator.consumed();
         }
@@ -118,51 +152,225 @@ namespace SequenceProcessFramework {
         }
 
     private:
+        std::string _name;
+
         static log4cxx::LoggerPtr logger;
     };
 
     template <class Input, class Output, class Generator, class Processor, class PostProcessor>
     log4cxx::LoggerPtr SerialWorker<Input, Output, Generator, Processor, PostProcessor>::logger(log4cxx::Logger::getLogger("arcs.SequenceProcessFramework"));
 
-#ifdef _OPENMP
+    //
+    // ReorderBuffer - A ring of work items shared by the stages of the ParallelWorker.
+    // Items are numbered in the input order. The reader fills free slots, the
+    // workers claim the filled items a few at a time and complete them in any
+    // order, and the writer takes them back in the input order as soon as every
+    // earlier item is complete. A slot is refilled as soon as it is released.
+    //
+    template <class Input, class Output>
+    class ReorderBuffer {
+    public:
+        struct Slot {
+            Slot() : done(false) {
+            }
+            Input input;
+            Output output;
+            bool done;
+            WorkerStats::Clock::time_point generated;
+        };
+
+        ReorderBuffer(size_t capacity, size_t workers=1) : _slots(capacity), _workers(workers), _filled(0), _claimed(0), _released(0), _closed(false) {
+            assert(capacity > 0 && workers > 0);
+        }
+
+        Slot& operator[](size_t k) {
+            return _slots[k % _slots.size()];
+        }
+
+        // Reader: wait for free slots, the items [first, last) may be filled
+        void reserve(size_t n, size_t* first, size_t* last) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _space.wait(lock, [this] { return _filled < _released + _slots.size(); });
+            *first = _filled;
+            *last = std::min(_filled + n, _released + _slots.size());
+        }
+        // Reader: the items before last are filled, closed if no more will come
+        void fill(size_t last, bool closed) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _filled = last;
+            _closed = closed;
+            _work.notify_all();
+            if (closed) {
+                _ready.notify_all();
+            }
+        }
+
+        // Worker: claim up to n filled items, fails once all of them are claimed.
+        // No more than a fair share of the filled items is taken, so a short
+        // queue is spread over the workers. waited tells if there was no work.
+        bool claim(size_t n, size_t* first, size_t* last, bool* waited=NULL) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (waited != NULL) {
+                *waited = _claimed == _filled && !_closed;
+            }
+            _work.wait(lock, [this] { return _claimed < _filled || _closed; });
+            if (_claimed == _filled) {
+                return false;
+            }
+            size_t share = (_filled - _claimed + _workers - 1) / _workers;
+            *first = _claimed;
+            *last = _claimed = _claimed + std::min(n, share);
+            return true;
+        }
+        // Worker: the outputs of the claimed items [first, last) are set
+        void complete(size_t first, size_t last) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (size_t k = first; k < last; ++k) {
+                (*this)[k].done = true;
+            }
+            _ready.notify_one();
+        }
+
+        // Writer: wait for the next complete items [first, last) in the input order,
+        // fails once all of them are released
+        bool next(size_t* first, size_t* last) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _ready.wait(lock, [this] { return (_released < _filled && (*this)[_released].done) || (_closed && _released == _filled); });
+            if (_released == _filled) {
+                return false;
+            }
+            size_t k = _released;
+            while (k < _filled && (*this)[k].done) {
+                ++k;
+            }
+            *first = _released;
+            *last = k;
+            return true;
+        }
+        // Writer: the items before last are consumed, their slots can be refilled
+        void release(size_t last) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (size_t k = _released; k < last; ++k) {
+                (*this)[k].done = false;
+            }
+            _released = last;
+            _space.notify_one();
+        }
+    private:
+        std::vector<Slot> _slots;
+        size_t _workers;
+        size_t _filled;
+        size_t _claimed;
+        size_t _released;
+        bool _closed;
+
+        std::mutex _mutex;
+        std::condition_variable _space;
+        std::condition_variable _work;
+        std::condition_variable _ready;
+    };
+
+    // Process the work items in a pipeline: a reader thread fills a reorder buffer
+    // from the generator, every worker of a work stealing pool (one per processor)
+    // pulls items from it continuously and the calling thread hands the results
+    // to the post processor in the input order as soon as they are complete. A
+    // slow item only holds back the output, the buffer of 2 * threads * batch
+    // items keeps the workers busy meanwhile. The number of items claimed at once
+    // adapts to the cost of the items, up to batch.
     template <class Input, class Output, class Generator, class Processor, class PostProcessor>
     class ParallelWorker {
     public:
+        ParallelWorker(const std::string& name="worker") : _name(name) {
+        }
+
         size_t run(Generator& generator, std::vector<Processor *>* proclist, PostProcessor* postproc, size_t batch=1000, size_t n=-1) {
+            typedef WorkerStats::Clock Clock;
             size_t threads = proclist->size();
-            omp_set_num_threads(threads);
-
-            bool done = false;
-            std::vector<Input> inputs;
-            while (!done) {
-                Input workItem;
-                if (generator.consumed() < n && generator.generate(workItem)) {
-                    inputs.push_back(workItem);
-                } else {
-                    done = true;
-                }
+            assert(threads > 0 && batch > 0);
+
+            WorkerStats stats(_name, threads);
+            stats.start();
 
-                // Once all buffers are full or the input is finished, dispatch the work to the threads
-                if (inputs.size() == threads * batch || done) { 
-                    std::vector<Output> outputs(inputs.size());
+            typedef ReorderBuffer<Input, Output> Buffer;
+            Buffer buffer(2 * threads * batch, threads);
 
-                    #pragma omp parallel for schedule(dynamic)
-                    for (size_t i = 0; i < inputs.size(); ++i) {
-                        size_t tid = omp_get_thread_num();
-                        outputs[i] = (*proclist)[tid]->process(inputs[i]);
+            // The number of items taken at once by a worker or the reader
+            BatchSizer sizer(std::max(batch / 64, (size_t)1), batch);
+
+            // Processor t is only used by task t. The tasks are waited for before
+            // the stats, the workers account for their last idle time.
+            ThreadPool pool(threads);
+            ThreadPool::TaskGroup workers(pool);
+            for (size_t t = 0; t < threads; ++t) {
+                workers.run([&, t] {
+                        Processor* proc = (*proclist)[t];
+                        size_t first, last;
+                        bool waited;
+                        Clock::time_point t0 = Clock::now();
+                        while (buffer.claim(sizer.size(), &first, &last, &waited)) {
+                            Clock::time_point t1 = Clock::now();
+                            for (size_t k = first; k < last; ++k) {
+                                typename Buffer::Slot& slot = buffer[k];
+                                slot.output = proc->process(slot.input);
+                            }
+                            Clock::time_point t2 = Clock::now();
+                            buffer.complete(first, last);
+                            Clock::time_point t3 = Clock::now();
+
+                            // Waiting for the reader is not a scheduling cost
+                            std::chrono::duration<double> items = t2 - t1, scheduling = (t3 - t2) + (waited ? Clock::duration(0) : t1 - t0);
+                            sizer.update(last - first, items.count(), scheduling.count());
+                            stats.processed(t, t2 - t1, (t1 - t0) + (t3 - t2), last - first);
+                            t0 = t3;
+                        }
+                        stats.processed(t, Clock::duration(0), Clock::now() - t0, 0);
+                    });
+            }
+
+            std::thread reader([&] {
+                    bool done = false;
+                    while (!done) {
+                        size_t first, last;
+                        buffer.reserve(sizer.size(), &first, &last);
+                        Clock::time_point t0 = Clock::now();
+                        size_t k = first;
+                        while (k < last && generator.consumed() < n && generator.generate(buffer[k].input)) {
+                            buffer[k].generated = Clock::now();
+                            ++k;
+                        }
+                        stats.generated(Clock::now() - t0, k - first);
+                        done = k < last;
+                        buffer.fill(k, done);
                     }
+                });
 
+            size_t processed = 0, logged = 0;
+            size_t first, last;
+            while (buffer.next(&first, &last)) {
+                Clock::time_point t0 = Clock::now();
+                for (size_t k = first; k < last; ++k) {
+                    typename Buffer::Slot& slot = buffer[k];
                     if (postproc != NULL) {
-                        for (size_t i = 0; i < inputs.size(); ++i) {
-                            postproc->process(inputs[i], outputs[i]);
-                        }
+                        postproc->process(slot.input, slot.output);
                     }
-                    inputs.clear();
+                    stats.latency(t0 - slot.generated);
+                }
+                stats.postprocessed(Clock::now() - t0, last - first);
+                buffer.release(last);
 
-                    LOG4CXX_INFO(logger, boost::format("processed %d sequences") % generator.consumed());
+                processed = last;
+                if (processed - logged >= threads * batch) {
+                    LOG4CXX_INFO(logger, boost::format("processed %d sequences") % processed);
+                    logged = processed;
                 }
             }
-            
+
+            reader.join();
+            workers.wait();
+            LOG4CXX_INFO(logger, boost::format("processed %d sequences") % processed);
+            LOG4CXX_INFO(logger, boost::format("batch size: %d (min: %d, max: %d)") % sizer.size() % sizer.minimum() % sizer.maximum());
+            stats.stop();
+
             return generator.consumed();
         }
 
@@ -182,13 +390,67 @@ namespace SequenceProcessFramework {
             std::ofstream stream(filename.c_str());
             return run(stream, proclist, postproc, batch, n);
         }
+
+        //
+        // BatchSizer - Size the batches so that claiming and completing them
+        // costs about 1% of processing their items. The cost of an item is an
+        // exponential moving average, the cost of a batch a slowly rising minimum
+        // as its samples also include the time a thread is preempted.
+        //
+        class BatchSizer {
+        public:
+            BatchSizer(size_t initial, size_t limit) : _size(initial), _limit(limit), _logged(initial), _minimum(initial), _maximum(initial), _item(0), _scheduling(0) {
+            }
+
+            size_t size() const {
+                return _size;
+            }
+            size_t minimum() const {
+                std::lock_guard<std::mutex> lock(_mutex);
+                return _minimum;
+            }
+            size_t maximum() const {
+                std::lock_guard<std::mutex> lock(_mutex);
+                return _maximum;
+            }
+
+            void update(size_t items, double itemSeconds, double schedulingSeconds) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                const double alpha = 0.1;
+                double item = itemSeconds / items;
+                _item = _item > 0 ? (1 - alpha) * _item + alpha * item : item;
+                _scheduling = _scheduling > 0 ? std::min(schedulingSeconds, _scheduling * 1.05) : schedulingSeconds;
+                if (_item <= 0) {
+                    return;
+                }
+
+                size_t size = std::max(std::min((size_t)std::ceil(100 * _scheduling / _item), _limit), (size_t)1);
+                _size = size;
+                _minimum = std::min(_minimum, size);
+                _maximum = std::max(_maximum, size);
+                if (size >= 2 * _logged || 2 * size <= _logged) {
+                    LOG4CXX_DEBUG(logger, boost::format("batch size: %d (%.3fus per item, %.3fus per batch)") % size % (_item * 1e6) % (_scheduling * 1e6));
+                    _logged = size;
+                }
+            }
+        private:
+            std::atomic<size_t> _size;
+            size_t _limit;
+            size_t _logged;
+            size_t _minimum;
+            size_t _maximum;
+            double _item;
+            double _scheduling;
+            mutable std::mutex _mutex;
+        };
     private:
+        std::string _name;
+
         static log4cxx::LoggerPtr logger;
     };
 
     template <class Input, class Output, class Generator, class Processor, class PostProcessor>
     log4cxx::LoggerPtr ParallelWorker<Input, Output, Generator, Processor, PostProcessor>::logger(log4cxx::Logger::getLogger("arcs.SequenceProcessFramework"));
-#endif // _OPENMP
 };
 
 #endif // sequence_process_framework_h_
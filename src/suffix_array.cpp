@@ -1,6 +1,7 @@
 #include "suffix_array.h"
 #include "utils.h"
 
+#include <cassert>
 #include <fstream>
 
 static const uint16_t FILE_MAGIC = 0xCACA;
@@ -99,6 +100,30 @@ std::istream& operator>>(std::istream& stream, SuffixArray& sa) {
     return stream;
 }
 
+void SuffixArray::filter(const std::vector<bool>& keep) {
+    assert(keep.size() == _strings);
+
+    // The new index of every kept string
+    std::vector<size_t> ranks(keep.size());
+    size_t strings = 0;
+    for (size_t i = 0; i < keep.size(); ++i) {
+        if (keep[i]) {
+            ranks[i] = strings++;
+        }
+    }
+
+    // Removing elements keeps the relative order of the others
+    size_t n = 0;
+    for (size_t k = 0; k < _elems.size(); ++k) {
+        const Elem& elem = _elems[k];
+        if (keep[elem.i]) {
+            _elems[n++] = Elem(ranks[elem.i], elem.j);
+        }
+    }
+    _elems.resize(n);
+    _strings = strings;
+}
+
 SuffixArray* SuffixArray::load(const std::string& filename) {
     std::ifstream stream(filename.c_str());
     return load(stream);
@@ -45,6 +45,10 @@ public:
         return _elems[i];
     }
 
+    // Remove the suffixes of the strings that are not kept and renumber the
+    // kept strings in order. The result is the suffix array of the kept strings.
+    void filter(const std::vector<bool>& keep);
+
     static SuffixArray* load(const std::string& filename);
     static SuffixArray* load(std::istream& stream);
 private:
@@ -0,0 +1,138 @@
+#include "thread_pool.h"
+
+#include <cassert>
+#include <chrono>
+
+// The id of a thread outside of the pool
+static const size_t kNone = (size_t)-1;
+
+// The pool and the index of the worker running on this thread
+static thread_local const ThreadPool* currentPool = NULL;
+static thread_local size_t currentId = kNone;
+
+ThreadPool::ThreadPool(size_t threads) : _queued(0), _next(0), _stop(false) {
+    assert(threads > 0);
+    for (size_t i = 0; i < threads; ++i) {
+        _workers.push_back(std::unique_ptr<Worker>(new Worker()));
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        _workers[i]->thread = std::thread(&ThreadPool::loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+        _wakeup.notify_all();
+    }
+    for (auto& worker : _workers) {
+        worker->thread.join();
+    }
+}
+
+size_t ThreadPool::id() const {
+    return currentPool == this ? currentId : kNone;
+}
+
+void ThreadPool::submit(const Task& task) {
+    size_t i = id();
+    if (i == kNone) {
+        i = _next++ % _workers.size();
+    }
+    // Counted before it is visible, so _queued never drops below the real number
+    ++_queued;
+    {
+        Worker& worker = *_workers[i];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.tasks.push_back(task);
+    }
+    {
+        // Taking the lock makes sure a worker going to sleep sees the new task
+        std::lock_guard<std::mutex> lock(_mutex);
+        _wakeup.notify_one();
+    }
+}
+
+bool ThreadPool::pop(size_t id, Task& task) {
+    if (_queued == 0) {
+        return false;
+    }
+
+    // Newest own task first, it is likely to be hot in the cache
+    if (id != kNone) {
+        Worker& worker = *_workers[id];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (!worker.tasks.empty()) {
+            task = worker.tasks.back();
+            worker.tasks.pop_back();
+            --_queued;
+            return true;
+        }
+    }
+
+    // Steal the oldest task of another worker
+    size_t start = (id == kNone ? 0 : id + 1);
+    for (size_t k = 0; k < _workers.size(); ++k) {
+        Worker& victim = *_workers[(start + k) % _workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            --_queued;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::loop(size_t id) {
+    currentPool = this;
+    currentId = id;
+
+    while (true) {
+        Task task;
+        if (pop(id, task)) {
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _wakeup.wait(lock, [this] { return _stop || _queued > 0; });
+        if (_stop && _queued == 0) {
+            break;
+        }
+    }
+}
+
+//
+// TaskGroup
+//
+void ThreadPool::TaskGroup::run(const Task& task) {
+    ++_pending;
+    _pool.submit([this, task] {
+            task();
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (--_pending == 0) {
+                _done.notify_all();
+            }
+        });
+}
+
+void ThreadPool::TaskGroup::wait() {
+    size_t id = _pool.id();
+    while (_pending > 0) {
+        Task task;
+        if (_pool.pop(id, task)) {
+            task();
+            continue;
+        }
+
+        // The remaining tasks of the group are running on other threads
+        std::unique_lock<std::mutex> lock(_mutex);
+        _done.wait_for(lock, std::chrono::milliseconds(1), [this] { return _pending == 0; });
+    }
+
+    // The last task may still hold the lock while notifying
+    std::lock_guard<std::mutex> lock(_mutex);
+}
@@ -0,0 +1,77 @@
+#ifndef thread_pool_h_
+#define thread_pool_h_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//
+// ThreadPool - A fixed set of worker threads scheduling tasks by work stealing.
+// Every worker owns a deque, it runs its own tasks from the back and steals from
+// the front of the others when it runs dry.
+//
+class ThreadPool {
+public:
+    typedef std::function<void()> Task;
+
+    ThreadPool(size_t threads);
+    ~ThreadPool();
+
+    size_t size() const {
+        return _workers.size();
+    }
+
+    // Queue a task. Tasks submitted by a worker go to its own deque, the others
+    // are spread over the workers.
+    void submit(const Task& task);
+
+    // The index of the calling worker in [0, size()), or -1 if the calling thread
+    // does not belong to this pool.
+    size_t id() const;
+
+    //
+    // TaskGroup - A set of tasks that can be waited for. wait() runs the pending
+    // tasks of the pool while the group is not finished, so a task can start a
+    // group and wait for it without blocking a worker (nested parallelism).
+    //
+    class TaskGroup {
+    public:
+        TaskGroup(ThreadPool& pool) : _pool(pool), _pending(0) {
+        }
+        ~TaskGroup() {
+            wait();
+        }
+
+        void run(const Task& task);
+        void wait();
+    private:
+        ThreadPool& _pool;
+        std::atomic<size_t> _pending;
+        std::mutex _mutex;
+        std::condition_variable _done;
+    };
+private:
+    struct Worker {
+        std::deque<Task> tasks;
+        std::mutex mutex;
+        std::thread thread;
+    };
+
+    void loop(size_t id);
+    // Take a task from the deque of worker id, or steal one from the others
+    bool pop(size_t id, Task& task);
+
+    std::vector<std::unique_ptr<Worker> > _workers;
+    std::atomic<size_t> _queued;
+    std::atomic<size_t> _next;
+    bool _stop;
+    std::mutex _mutex;
+    std::condition_variable _wakeup;
+};
+
+#endif // thread_pool_h_
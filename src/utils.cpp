@@ -1,11 +1,13 @@
 #include "utils.h"
+#include "bgzf.h"
+#include "codec.h"
 #include "constant.h"
 
 #include <boost/algorithm/string.hpp>
 #include <boost/iostreams/device/file_descriptor.hpp>
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/iostreams/filter/bzip2.hpp>
-#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/stream.hpp>
 
 #include <log4cxx/logger.h>
 
@@ -13,14 +15,31 @@ static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("arcs.Utils"));
 
 namespace Utils {
     std::istream* ifstream(const std::string& filename) {
+        if (boost::algorithm::ends_with(filename, GZIP_EXT)) {
+            // Decompressed ahead of the caller and seekable
+            try {
+                return new boost::iostreams::stream<BGZFSource>(BGZFSource(filename), 1 << 16);
+            } catch (...) {
+            }
+            return NULL;
+        }
+
         boost::iostreams::filtering_istream* stream = new boost::iostreams::filtering_istream();
         try {
-            if (boost::algorithm::ends_with(filename, GZIP_EXT)) {
-                stream->push(boost::iostreams::gzip_decompressor());
-            } else if (boost::algorithm::ends_with(filename, BZIP_EXT)) {
+            if (boost::algorithm::ends_with(filename, BZIP_EXT)) {
                 stream->push(boost::iostreams::bzip2_decompressor());
+                stream->push(boost::iostreams::file_descriptor_source(filename));
+#ifdef HAVE_ZSTD_H
+            } else if (boost::algorithm::ends_with(filename, ZSTD_EXT)) {
+                stream->push(ZstdSource(filename));
+#endif
+#ifdef HAVE_LZ4FRAME_H
+            } else if (boost::algorithm::ends_with(filename, LZ4_EXT)) {
+                stream->push(LZ4Source(filename));
+#endif
+            } else {
+                stream->push(boost::iostreams::file_descriptor_source(filename));
             }
-            stream->push(boost::iostreams::file_descriptor_source(filename));
         } catch (...) {
             SAFE_DELETE(stream);
         }
@@ -30,14 +49,65 @@ namespace Utils {
         boost::iostreams::filtering_ostream* stream = new boost::iostreams::filtering_ostream();
         try {
             if (boost::algorithm::ends_with(filename, GZIP_EXT)) {
-                stream->push(boost::iostreams::gzip_compressor());
+                // Blocked gzip, compressed on BGZFSink::threads() threads
+                stream->push(BGZFSink(filename));
             } else if (boost::algorithm::ends_with(filename, BZIP_EXT)) {
                 stream->push(boost::iostreams::bzip2_compressor());
+                stream->push(boost::iostreams::file_descriptor_sink(filename));
+#ifdef HAVE_ZSTD_H
+            } else if (boost::algorithm::ends_with(filename, ZSTD_EXT)) {
+                stream->push(ZstdSink(filename));
+#endif
+#ifdef HAVE_LZ4FRAME_H
+            } else if (boost::algorithm::ends_with(filename, LZ4_EXT)) {
+                stream->push(LZ4Sink(filename));
+#endif
+            } else {
+                stream->push(boost::iostreams::file_descriptor_sink(filename));
             }
-            stream->push(boost::iostreams::file_descriptor_sink(filename));
         } catch (...) {
             SAFE_DELETE(stream);
         }
         return stream;
     }
+
+    // The codecs of the intermediate files, fastest first
+    static const char* kCodecs[][2] = {
+#ifdef HAVE_ZSTD_H
+        {"zstd", ZSTD_EXT}, 
+#endif
+#ifdef HAVE_LZ4FRAME_H
+        {"lz4", LZ4_EXT}, 
+#endif
+        {"gzip", GZIP_EXT}, 
+        {"bzip2", BZIP_EXT}, 
+        {"none", ""}, 
+    };
+    static size_t intermediate = 0;
+
+    std::string intermediateCodec() {
+        return kCodecs[intermediate][0];
+    }
+    bool intermediateCodec(const std::string& name) {
+        for (size_t i = 0; i < SIZEOF_ARRAY(kCodecs); ++i) {
+            if (name == kCodecs[i][0]) {
+                intermediate = i;
+                return true;
+            }
+        }
+        return false;
+    }
+    std::string intermediateCodecs() {
+        std::string names;
+        for (size_t i = 0; i < SIZEOF_ARRAY(kCodecs); ++i) {
+            if (i > 0) {
+                names += ",";
+            }
+            names += kCodecs[i][0];
+        }
+        return names;
+    }
+    std::string intermediateExt() {
+        return kCodecs[intermediate][1];
+    }
 };
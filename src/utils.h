@@ -32,6 +32,14 @@
 namespace Utils {
     std::istream* ifstream(const std::string& filename);
     std::ostream* ofstream(const std::string& filename);
+
+    // The codec of the intermediate files (hits, graphs), the fastest one built
+    // in unless it is set by name. False if name is not built in.
+    std::string intermediateCodec();
+    bool intermediateCodec(const std::string& name);
+    std::string intermediateCodecs();
+    // The extension of the intermediate files
+    std::string intermediateExt();
 };
 
 #endif // utils_h_
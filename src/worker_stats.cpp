@@ -0,0 +1,179 @@
+#include "worker_stats.h"
+
+#include <fstream>
+
+#include <boost/format.hpp>
+
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include <log4cxx/logger.h>
+
+static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("arcs.WorkerStats"));
+
+// Process wide settings and results
+static std::mutex statsMutex;
+static double statsInterval = 0;
+static std::vector<std::string> statsRuns;
+
+WorkerStats::WorkerStats(const std::string& name, size_t threads) : _name(name), _elapsed(0), _generated(0), _generator(0), _postprocessed(0), _postprocessor(0), _threads(new Thread[threads]), _numThreads(threads), _latencies(new Counter[kLatencyBuckets]), _running(false) {
+    for (size_t i = 0; i < kLatencyBuckets; ++i) {
+        _latencies[i] = 0;
+    }
+}
+
+WorkerStats::~WorkerStats() {
+    if (_running) {
+        stop();
+    }
+}
+
+void WorkerStats::start() {
+    _start = Clock::now();
+    _running = true;
+
+    double interval;
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        interval = statsInterval;
+    }
+    if (interval > 0) {
+        _sampler = std::thread([this, interval] {
+                std::unique_lock<std::mutex> lock(_mutex);
+                while (!_stopped.wait_for(lock, std::chrono::duration<double>(interval), [this] { return !_running; })) {
+                    sample();
+                }
+            });
+    }
+}
+
+void WorkerStats::stop() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _elapsed = nanoseconds(Clock::now() - _start);
+        _running = false;
+        _stopped.notify_all();
+    }
+    if (_sampler.joinable()) {
+        _sampler.join();
+    }
+
+    std::string stats = json();
+    LOG4CXX_INFO(logger, boost::format("stats: %s") % stats);
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    statsRuns.push_back(stats);
+}
+
+void WorkerStats::generated(Clock::duration elapsed, size_t items) {
+    add(_generator, nanoseconds(elapsed));
+    add(_generated, items);
+}
+
+void WorkerStats::processed(size_t thread, Clock::duration busy, Clock::duration idle, size_t items) {
+    Thread& t = _threads[thread];
+    add(t.busy, nanoseconds(busy));
+    add(t.idle, nanoseconds(idle));
+    add(t.items, items);
+}
+
+void WorkerStats::postprocessed(Clock::duration elapsed, size_t items) {
+    add(_postprocessor, nanoseconds(elapsed));
+    add(_postprocessed, items);
+}
+
+void WorkerStats::latency(Clock::duration elapsed, size_t items) {
+    uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    size_t bucket = 0;
+    while (us > 0 && bucket + 1 < kLatencyBuckets) {
+        us >>= 1;
+        ++bucket;
+    }
+    add(_latencies[bucket], items);
+}
+
+std::string WorkerStats::json() const {
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+
+    double elapsed = (_running ? nanoseconds(Clock::now() - _start) : _elapsed.load()) / 1e9;
+    uint64_t items = _postprocessed;
+    double processor = 0;
+    for (size_t i = 0; i < _numThreads; ++i) {
+        processor += _threads[i].busy / 1e9;
+    }
+
+    writer.StartObject();
+    writer.String("name");
+    writer.String(_name.c_str());
+    writer.String("threads");
+    writer.Uint64(_numThreads);
+    writer.String("items");
+    writer.Uint64(items);
+    writer.String("seconds");
+    writer.Double(elapsed);
+    writer.String("items_per_second");
+    writer.Double(elapsed > 0 ? items / elapsed : 0);
+    writer.String("generator_seconds");
+    writer.Double(_generator / 1e9);
+    writer.String("processor_seconds");
+    writer.Double(processor);
+    writer.String("postprocessor_seconds");
+    writer.Double(_postprocessor / 1e9);
+
+    writer.String("busy_seconds");
+    writer.StartArray();
+    for (size_t i = 0; i < _numThreads; ++i) {
+        writer.Double(_threads[i].busy / 1e9);
+    }
+    writer.EndArray();
+    writer.String("idle_seconds");
+    writer.StartArray();
+    for (size_t i = 0; i < _numThreads; ++i) {
+        writer.Double(_threads[i].idle / 1e9);
+    }
+    writer.EndArray();
+
+    // Bucket i holds the latencies below 2^i microseconds
+    writer.String("latency_us");
+    writer.StartObject();
+    for (size_t i = 0; i < kLatencyBuckets; ++i) {
+        uint64_t count = _latencies[i];
+        if (count > 0) {
+            writer.String(boost::str(boost::format("<%d") % (1ull << i)).c_str());
+            writer.Uint64(count);
+        }
+    }
+    writer.EndObject();
+    writer.EndObject();
+
+    return buffer.GetString();
+}
+
+void WorkerStats::sample() {
+    LOG4CXX_INFO(logger, boost::format("sample: %s") % json());
+}
+
+void WorkerStats::sampleInterval(double seconds) {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    statsInterval = seconds;
+}
+
+std::string WorkerStats::summary() {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    std::string json = "[";
+    for (size_t i = 0; i < statsRuns.size(); ++i) {
+        if (i > 0) {
+            json += ",";
+        }
+        json += statsRuns[i];
+    }
+    json += "]";
+    return json;
+}
+
+bool WorkerStats::write(const std::string& filename) {
+    std::ofstream stream(filename.c_str());
+    stream << summary() << std::endl;
+    return (bool)stream;
+}
@@ -0,0 +1,87 @@
+#ifndef worker_stats_h_
+#define worker_stats_h_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//
+// WorkerStats - Throughput and latency counters of a run of a
+// SequenceProcessFramework worker: the time spent in the generator, the
+// processors and the post processor, the busy and idle time of every processor
+// and a histogram of the latencies of the items from generated to post processed.
+//
+// Every counter has a single writer, so they are updated without locks and can
+// be sampled by another thread while the run goes on.
+//
+class WorkerStats {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    WorkerStats(const std::string& name, size_t threads);
+    ~WorkerStats();
+
+    void start();
+    void stop();
+
+    void generated(Clock::duration elapsed, size_t items);
+    void processed(size_t thread, Clock::duration busy, Clock::duration idle, size_t items);
+    void postprocessed(Clock::duration elapsed, size_t items);
+    void latency(Clock::duration elapsed, size_t items=1);
+
+    // The counters as a compact JSON object
+    std::string json() const;
+
+    // Log a sample of the counters every interval seconds while running, 0 disables
+    static void sampleInterval(double seconds);
+    // The counters of all the runs stopped so far, as a JSON array
+    static std::string summary();
+    // Write the summary to a file
+    static bool write(const std::string& filename);
+private:
+    typedef std::atomic<uint64_t> Counter;
+
+    // Latencies are counted in power of 2 buckets of microseconds
+    static const size_t kLatencyBuckets = 40;
+
+    struct Thread {
+        Thread() : busy(0), idle(0), items(0) {
+        }
+        Counter busy;
+        Counter idle;
+        Counter items;
+    };
+
+    static void add(Counter& counter, uint64_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+    static uint64_t nanoseconds(Clock::duration elapsed) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    }
+
+    void sample();
+
+    std::string _name;
+    Clock::time_point _start;
+    Counter _elapsed;
+    Counter _generated;
+    Counter _generator;
+    Counter _postprocessed;
+    Counter _postprocessor;
+    std::unique_ptr<Thread[]> _threads;
+    size_t _numThreads;
+    std::unique_ptr<Counter[]> _latencies;
+
+    // Periodic sampling
+    std::thread _sampler;
+    bool _running;
+    std::mutex _mutex;
+    std::condition_variable _stopped;
+};
+
+#endif // worker_stats_h_
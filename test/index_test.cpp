@@ -2,11 +2,49 @@
 #include <boost/test/included/unit_test.hpp>
 
 #include "alphabet.h"
+#include "constant.h"
+#include "fmindex.h"
 #include "rlstring.h"
+#include "runner.h"
 #include "suffix_array.h"
+#include "suffix_array_builder.h"
+#include "utils.h"
+
+#include "test_utils.h"
+
+#include <memory>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
 
 BOOST_AUTO_TEST_SUITE(Indexer);
 
+// Forward strand reads of 100 bases every 10 bases of a random genome, with
+// exact copies and reads contained in others
+static DNASeqList simulateReads() {
+    std::string genome = simulateGenome(2500, 11);
+
+    DNASeqList reads;
+    for (size_t i = 0; i + 100 <= genome.length(); i += 10) {
+        reads.push_back(DNASeq(boost::str(boost::format("read%d") % reads.size()), genome.substr(i, 100)));
+        if (i % 70 == 0) {
+            reads.push_back(DNASeq(boost::str(boost::format("read%d") % reads.size()), genome.substr(i, 100)));
+        } else if (i % 110 == 0) {
+            reads.push_back(DNASeq(boost::str(boost::format("read%d") % reads.size()), genome.substr(i + 20, 60)));
+        }
+    }
+    return reads;
+}
+
+// The index files of two prefixes are identical
+static void checkIndex(const std::string& prefix, const std::string& expected) {
+    const char* exts[] = {SAI_EXT, BWT_EXT, RSAI_EXT, RBWT_EXT};
+    for (size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); ++i) {
+        BOOST_CHECK_MESSAGE(readFile(prefix + exts[i]) == readFile(expected + exts[i]), prefix + exts[i]);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(Alphabet_torank) {
     BOOST_CHECK_EQUAL(DNAAlphabet::torank('$'), 0);
     BOOST_CHECK_EQUAL(DNAAlphabet::torank('A'), 1);
@@ -80,4 +118,102 @@ BOOST_AUTO_TEST_CASE(RLString_test) {
     BOOST_CHECK_EQUAL(runs[4].count(), 1);
 }
 
+BOOST_AUTO_TEST_CASE(FMIndex_getOcc2) {
+    DNASeqList reads;
+    reads.push_back(DNASeq("read1", "AAACGGGTACCCCATTTTTGA"));
+    reads.push_back(DNASeq("read2", "CGGGTACCCCATTTTTGAACC"));
+    reads.push_back(DNASeq("read3", "TTTTTTTTGGGGGGGGAAAAA"));
+
+    std::shared_ptr<SuffixArrayBuilder> builder(SuffixArrayBuilder::create("sais"));
+    std::shared_ptr<SuffixArray> sa(builder->build(reads));
+    FMIndex index(*sa, reads, 4);
+
+    // Both nearby and distant bounds must agree with the single rank queries,
+    // starting from the row before the first one
+    const size_t kNone = -1;
+    for (size_t l = kNone; l == kNone || l < index.length(); ++l) {
+        for (size_t u = l; u == kNone || u < index.length(); ++u) {
+            DNAAlphabet::AlphaCount64 lcounts, ucounts;
+            index.getOcc2(l, u, &lcounts, &ucounts);
+            BOOST_CHECK(lcounts == index.getOcc(l));
+            BOOST_CHECK(ucounts == index.getOcc(u));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Indexer_rmdup) {
+    TempDir dir;
+    std::string prefix = dir.path("reads");
+    writeReads(prefix + FA_EXT, simulateReads());
+
+    // index --rmdup
+    std::string fused = prefix + "-fused";
+    BOOST_CHECK_EQUAL(runCommand("index", {"prefix=" + fused, "rmdup"}, {prefix + FA_EXT}), 0);
+
+    // index, rmdup and index of the kept reads
+    BOOST_CHECK_EQUAL(runCommand("index", {"prefix=" + prefix}, {prefix + FA_EXT}), 0);
+    BOOST_CHECK_EQUAL(runCommand("rmdup", {"prefix=" + prefix}, {prefix + FA_EXT}), 0);
+    std::string kept = prefix + "-kept";
+    BOOST_CHECK_EQUAL(runCommand("index", {"prefix=" + kept}, {prefix + RMDUP_EXT + FA_EXT}), 0);
+
+    std::string dups = readFile(prefix + RMDUP_EXT + ".dups" + FA_EXT);
+    BOOST_CHECK(dups.find("seqrank=") != std::string::npos);
+    BOOST_CHECK(readFile(fused + RMDUP_EXT + FA_EXT) == readFile(prefix + RMDUP_EXT + FA_EXT));
+    BOOST_CHECK(readFile(fused + RMDUP_EXT + ".dups" + FA_EXT) == dups);
+    checkIndex(fused, kept);
+
+    // The codec of the intermediate files changes nothing
+    std::string reads = readFile(prefix + RMDUP_EXT + FA_EXT), codec = Utils::intermediateCodec();
+    std::vector<std::string> codecs;
+    boost::algorithm::split(codecs, Utils::intermediateCodecs(), boost::is_any_of(","));
+    for (const auto& name : codecs) {
+        for (size_t threads = 1; threads <= 2; ++threads) {
+            BOOST_CHECK_EQUAL(runCommand("rmdup", {"prefix=" + prefix, "intermediate-codec=" + name, boost::str(boost::format("threads=%d") % threads)}, {prefix + FA_EXT}), 0);
+            BOOST_CHECK_MESSAGE(readFile(prefix + RMDUP_EXT + FA_EXT) == reads, name);
+            BOOST_CHECK_MESSAGE(readFile(prefix + RMDUP_EXT + ".dups" + FA_EXT) == dups, name);
+        }
+    }
+    BOOST_CHECK(Utils::intermediateCodec(codec));
+}
+
+BOOST_AUTO_TEST_CASE(Indexer_remove) {
+    TempDir dir;
+    std::string prefix = dir.path("reads");
+    DNASeqList reads = simulateReads();
+    writeReads(prefix + FA_EXT, reads);
+    BOOST_CHECK_EQUAL(runCommand("index", {"prefix=" + prefix}, {prefix + FA_EXT}), 0);
+
+    // Remove every 9th read and the last one, in place
+    DNASeqList removed, kept;
+    for (size_t i = 0; i < reads.size(); ++i) {
+        if (i % 9 == 4 || i + 1 == reads.size()) {
+            removed.push_back(DNASeq(boost::str(boost::format("%s,seqrank=%d") % reads[i].name % i), reads[i].seq));
+        } else {
+            kept.push_back(reads[i]);
+        }
+    }
+    writeReads(prefix + ".dups" + FA_EXT, removed);
+    BOOST_CHECK_EQUAL(runCommand("index", {"prefix=" + prefix, "remove=" + prefix + ".dups" + FA_EXT}, {prefix + FA_EXT}), 0);
+
+    // The same as indexing the kept reads from scratch
+    std::string expected = prefix + "-kept";
+    writeReads(expected + FA_EXT, kept);
+    BOOST_CHECK_EQUAL(runCommand("index", {"prefix=" + expected}, {expected + FA_EXT}), 0);
+    checkIndex(prefix, expected);
+
+    // A seqrank out of the index or not matching its read
+    writeReads(prefix + ".bad" + FA_EXT, DNASeqList(1, DNASeq(boost::str(boost::format("x,seqrank=%d") % kept.size()), "ACGT")));
+    BOOST_CHECK(runCommand("index", {"prefix=" + prefix, "remove=" + prefix + ".bad" + FA_EXT}, {prefix + FA_EXT}) != 0);
+    writeReads(prefix + ".bad" + FA_EXT, DNASeqList(1, DNASeq("x,seqrank=0", kept.back().seq)));
+    BOOST_CHECK(runCommand("index", {"prefix=" + prefix, "remove=" + prefix + ".bad" + FA_EXT}, {prefix + FA_EXT}) != 0);
+    checkIndex(prefix, expected);
+
+    // A valid read with the reverse bwt missing leaves the forward index as it is
+    writeReads(prefix + ".bad" + FA_EXT, DNASeqList(1, DNASeq("x,seqrank=0", kept.front().seq)));
+    boost::filesystem::rename(prefix + RBWT_EXT, prefix + ".saved");
+    BOOST_CHECK(runCommand("index", {"prefix=" + prefix, "remove=" + prefix + ".bad" + FA_EXT}, {prefix + FA_EXT}) != 0);
+    boost::filesystem::rename(prefix + ".saved", prefix + RBWT_EXT);
+    checkIndex(prefix, expected);
+}
+
 BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,228 @@
+#define BOOST_TEST_MODULE "siga.io"
+#include <boost/test/included/unit_test.hpp>
+
+#include "bgzf.h"
+#include "codec.h"
+#include "constant.h"
+#include "utils.h"
+
+#include "test_utils.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/format.hpp>
+#include <boost/iostreams/stream.hpp>
+
+BOOST_AUTO_TEST_SUITE(io);
+
+// Reads in FASTA of n bytes at least, mostly bases with random bytes in between
+// so that some blocks do not compress
+static std::string simulateData(size_t n, size_t seed) {
+    std::mt19937 rng(seed);
+    std::string data;
+    for (size_t i = 0; data.length() < n; ++i) {
+        data += boost::str(boost::format(">read%d\n") % i);
+        size_t length = 50 + rng() % 200;
+        for (size_t j = 0; j < length; ++j) {
+            data += i % 97 == 0 ? (char)(rng() % 256) : "ACGT"[rng() % 4];
+        }
+        data += '\n';
+    }
+    return data;
+}
+
+static void writeFile(const std::string& file, const std::string& data) {
+    std::shared_ptr<std::ostream> stream(Utils::ofstream(file));
+    BOOST_REQUIRE(stream);
+    // Pieces of every size, some crossing the blocks
+    std::mt19937 rng(1);
+    for (size_t i = 0; i < data.length(); ) {
+        size_t k = std::min(data.length() - i, (size_t)(rng() % 100000));
+        stream->write(data.data() + i, k);
+        i += k;
+    }
+    BOOST_REQUIRE(*stream);
+}
+
+BOOST_AUTO_TEST_CASE(BGZF_roundtrip) {
+    // Before the first file is opened
+    BGZFSink::threads(3);
+
+    size_t sizes[] = {0, 10, 0xff00, 0xff01, 0x10000 + 1, 1 << 20};
+    TempDir dir;
+    for (auto size : sizes) {
+        std::string data = simulateData(size, size), file = dir.path("reads.fa.gz");
+        writeFile(file, data);
+        BOOST_CHECK(readFile(file) == data);
+
+        // Blocks of at most 64KB and the empty block at the end
+        std::string compressed = readFile(file, true);
+        BOOST_REQUIRE(compressed.length() >= 28);
+        size_t blocks = 0, offset = 0;
+        while (offset + 18 <= compressed.length()) {
+            const unsigned char* p = reinterpret_cast<const unsigned char *>(compressed.data() + offset);
+            BOOST_REQUIRE(p[0] == 0x1f && p[1] == 0x8b && p[12] == 'B' && p[13] == 'C');
+            offset += (p[16] | (p[17] << 8)) + 1;
+            ++blocks;
+        }
+        BOOST_CHECK_EQUAL(offset, compressed.length());
+        BOOST_CHECK_EQUAL(blocks, (data.length() + 0xff00 - 1) / 0xff00 + 1);
+        const unsigned char kEOF[28] = {
+            0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 0x42, 0x43,
+            0x02, 0x00, 0x1b, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        };
+        BOOST_CHECK(compressed.compare(compressed.length() - 28, 28, reinterpret_cast<const char *>(kEOF), 28) == 0);
+
+        // Any gzip tool reads it
+        std::string output = dir.path("reads.fa");
+        BOOST_CHECK_EQUAL(std::system(("gzip -d -c " + file + " > " + output).c_str()), 0);
+        BOOST_CHECK(readFile(output) == data);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(BGZF_seek) {
+    TempDir dir;
+    std::string data = simulateData(1 << 20, 5), file = dir.path("reads.fa.gz");
+    writeFile(file, data);
+
+    // Forward, backward, back to the start and past the blocks indexed so far
+    size_t offsets[] = {100, 0x30000, 0x20000 + 7, 0, data.length() - 10, 0xff00, 0xff00 - 1, 5, data.length()};
+    for (size_t k = 0; k < 2; ++k) {
+        std::shared_ptr<std::istream> stream(Utils::ifstream(file));
+        BOOST_REQUIRE(stream);
+        if (k > 0) {
+            // Everything indexed
+            std::string all((std::istreambuf_iterator<char>(*stream)), std::istreambuf_iterator<char>());
+            BOOST_CHECK(all == data);
+            stream->clear();
+        }
+        for (auto offset : offsets) {
+            stream->seekg(offset);
+            BOOST_REQUIRE(*stream);
+            BOOST_CHECK_EQUAL((size_t)stream->tellg(), offset);
+            char buf[32];
+            stream->read(buf, sizeof(buf));
+            BOOST_CHECK_EQUAL(std::string(buf, stream->gcount()), data.substr(offset, sizeof(buf)));
+            stream->clear();
+        }
+        // Relative to the current position
+        stream->seekg(1000);
+        stream->seekg(-500, std::ios_base::cur);
+        char c;
+        BOOST_CHECK(stream->get(c) && c == data[500]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Gzip_members) {
+    // A plain gzip file of several members, as written by cat a.gz b.gz
+    TempDir dir;
+    std::string data = simulateData(300000, 9), file = dir.path("reads.fa.gz"), plain = dir.path("reads.fa");
+    for (size_t i = 0; i < 3; ++i) {
+        {
+            std::ofstream stream(plain, std::ios::binary);
+            stream << data.substr(i * 100000, 100000);
+        }
+        BOOST_REQUIRE_EQUAL(std::system(("gzip -c " + plain + " >> " + file).c_str()), 0);
+    }
+    BOOST_CHECK(readFile(file) == data.substr(0, 300000));
+
+    // Seeking inflates again from the start
+    std::shared_ptr<std::istream> stream(Utils::ifstream(file));
+    BOOST_REQUIRE(stream);
+    size_t offsets[] = {250000, 1000, 199990};
+    for (auto offset : offsets) {
+        stream->seekg(offset);
+        char buf[20];
+        BOOST_REQUIRE(stream->read(buf, sizeof(buf)));
+        BOOST_CHECK_EQUAL(std::string(buf, sizeof(buf)), data.substr(offset, sizeof(buf)));
+    }
+
+    // A truncated member fails
+    std::string compressed = readFile(file, true);
+    {
+        std::ofstream stream(file, std::ios::binary);
+        stream << compressed.substr(0, compressed.length() - 100);
+    }
+    std::shared_ptr<std::istream> truncated(Utils::ifstream(file));
+    BOOST_REQUIRE(truncated);
+    std::string all;
+    BOOST_CHECK_THROW({
+            truncated->exceptions(std::ios_base::badbit);
+            all.assign(std::istreambuf_iterator<char>(*truncated), std::istreambuf_iterator<char>());
+        }, std::exception);
+}
+
+// Write data, then read it back in pieces of every size. The runs of bases
+// decode to much more than a piece, which is left in the decoder.
+template <class Sink, class Source>
+static void checkCodec(const std::string& ext) {
+    TempDir dir;
+    std::string data = simulateData(4 << 20, 3), file = dir.path("reads.fa" + ext);
+    for (size_t i = 0; i < data.length(); i += 1000) {
+        data.replace(i, 500, 500, 'A');
+    }
+    auto write = [](const std::string& file, const std::string& data) {
+        Sink sink(file);
+        for (size_t i = 0; i < data.length(); i += 300000) {
+            BOOST_CHECK_EQUAL(sink.write(data.data() + i, std::min(data.length() - i, (size_t)300000)), std::min(data.length() - i, (size_t)300000));
+        }
+        sink.close();
+    };
+    auto read = [](const std::string& file) {
+        Source source(file);
+        std::mt19937 rng(2);
+        std::string data;
+        std::vector<char> buf(1 << 20);
+        std::streamsize n;
+        while ((n = source.read(buf.data(), 1 + rng() % (rng() % 2 == 0 ? 100 : buf.size()))) > 0) {
+            data.append(buf.data(), n);
+        }
+        return data;
+    };
+
+    write(file, data);
+    BOOST_CHECK(read(file) == data);
+    BOOST_CHECK(readFile(file) == data);
+
+    // Frames written one after the other
+    std::string second = dir.path("second.fa" + ext), concatenated = dir.path("concatenated.fa" + ext), small = simulateData(1000, 4);
+    write(second, small);
+    {
+        std::ofstream stream(concatenated, std::ios::binary);
+        stream << readFile(file, true) << readFile(second, true) << readFile(file, true);
+    }
+    BOOST_CHECK(read(concatenated) == data + small + data);
+
+    // A truncated frame fails
+    std::string compressed = readFile(second, true);
+    for (size_t k = 1; k < compressed.length(); k += compressed.length() / 3) {
+        {
+            std::ofstream stream(concatenated, std::ios::binary);
+            stream << readFile(file, true) << compressed.substr(0, compressed.length() - k);
+        }
+        BOOST_CHECK_THROW(read(concatenated), std::ios_base::failure);
+    }
+
+    // An empty file has no frames
+    write(second, "");
+    BOOST_CHECK(read(second).empty());
+}
+
+#ifdef HAVE_ZSTD_H
+BOOST_AUTO_TEST_CASE(Zstd_codec) {
+    checkCodec<ZstdSink, ZstdSource>(ZSTD_EXT);
+}
+#endif
+
+#ifdef HAVE_LZ4FRAME_H
+BOOST_AUTO_TEST_CASE(LZ4_codec) {
+    checkCodec<LZ4Sink, LZ4Source>(LZ4_EXT);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END();
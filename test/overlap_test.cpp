@@ -2,10 +2,94 @@
 #include <boost/test/included/unit_test.hpp>
 
 #include "asqg.h"
+#include "bwt.h"
+#include "constant.h"
+#include "fmindex.h"
+#include "kseq.h"
 #include "overlap_builder.h"
+#include "suffix_array.h"
+#include "suffix_array_builder.h"
+#include "utils.h"
+
+#include "test_utils.h"
+
+#include <fstream>
+#include <memory>
+#include <set>
+
+#include <boost/format.hpp>
 
 BOOST_AUTO_TEST_SUITE(overlap);
 
+// Reads of 100 bases every 10 bases of a random genome, with a 150 bases
+// repeat at five places. Every third read is reverse complemented.
+static DNASeqList simulateReads() {
+    std::string genome = simulateGenome(3000, 7);
+    for (size_t i = 1; i < 5; ++i) {
+        genome.replace(i * 600, 150, genome, 0, 150);
+    }
+
+    DNASeqList reads;
+    for (size_t i = 0; i + 100 <= genome.length(); i += 10) {
+        DNASeq read(boost::str(boost::format("read%d") % reads.size()), genome.substr(i, 100));
+        if (reads.size() % 3 == 2) {
+            make_dna_reverse_complement(read.seq);
+        }
+        reads.push_back(read);
+    }
+    return reads;
+}
+
+// The simulated reads with exact copies, reverse complemented copies and
+// reads contained in others
+static DNASeqList simulateDuplicates() {
+    DNASeqList reads = simulateReads();
+    for (size_t i = 0, n = reads.size(); i < n; ++i) {
+        std::string name = boost::str(boost::format("copy%d") % i);
+        if (i % 7 == 0) {
+            reads.push_back(DNASeq(name, reads[i].seq));
+        } else if (i % 11 == 0) {
+            reads.push_back(DNASeq(name, make_dna_reverse_complement_copy(reads[i].seq)));
+        } else if (i % 13 == 0) {
+            reads.push_back(DNASeq(name, reads[i].seq.substr(20, 60)));
+        }
+    }
+    return reads;
+}
+
+// Write the reads and their forward and reverse indices as index does
+static void writeIndex(const std::string& prefix, DNASeqList reads) {
+    writeReads(prefix + FA_EXT, reads);
+    std::shared_ptr<SuffixArrayBuilder> builder(SuffixArrayBuilder::create("sais"));
+    for (size_t k = 0; k < 2; ++k) {
+        if (k > 0) {
+            for (auto& read : reads) {
+                read.make_reverse();
+            }
+        }
+        std::shared_ptr<SuffixArray> sa(builder->build(reads));
+        std::ofstream(prefix + (k > 0 ? RSAI_EXT : SAI_EXT)) << *sa;
+        std::ofstream(prefix + (k > 0 ? RBWT_EXT : BWT_EXT)) << BWT(*sa, reads);
+    }
+}
+
+// The edges and the aborted vertices of an ASQG
+static void parseGraph(const std::string& asqg, std::set<std::string>* edges, std::set<std::string>* aborted) {
+    std::stringstream stream(asqg);
+    std::string line;
+    while (std::getline(stream, line)) {
+        if (ASQG::recordtype(line) == ASQG::RT_VERTEX) {
+            ASQG::VertexRecord record;
+            BOOST_REQUIRE(ASQG::VertexRecord::parse(line, record));
+            if (record.aborted && (int)record.aborted) {
+                aborted->insert(record.id);
+            }
+        } else if (ASQG::recordtype(line) == ASQG::RT_EDGE) {
+            edges->insert(line);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(ASQG_fmt) {
     {
         ASQG::IntTagValue tag;
@@ -27,9 +111,125 @@ BOOST_AUTO_TEST_CASE(ASQG_fmt) {
     }
 }
 
-BOOST_AUTO_TEST_CASE(OverlapBuilder) {
-    int i = 1;
-    BOOST_CHECK(i);
+BOOST_AUTO_TEST_CASE(OverlapBuilder_limits) {
+    TempDir dir;
+    std::string prefix = dir.path("reads");
+    writeIndex(prefix, simulateReads());
+
+    FMIndex fmi, rfmi;
+    BOOST_REQUIRE(FMIndex::load(prefix + BWT_EXT, fmi) && FMIndex::load(prefix + RBWT_EXT, rfmi));
+
+    auto build = [&](const OverlapBuilder::Limits& limits, size_t threads) {
+        std::ifstream stream(prefix + FA_EXT);
+        std::shared_ptr<DNASeqReader> reader(DNASeqReaderFactory::create(stream));
+        std::stringstream asqg;
+        OverlapBuilder builder(&fmi, &rfmi, prefix, true, true, limits);
+        BOOST_CHECK(builder.build(*reader, 45, asqg, threads, 16));
+        return asqg.str();
+    };
+
+    std::set<std::string> expected, none;
+    parseGraph(build(OverlapBuilder::Limits(), 1), &expected, &none);
+    BOOST_CHECK(!expected.empty());
+    BOOST_CHECK(none.empty());
+
+    // An aborted read has no edges at all, the other edges are kept
+    OverlapBuilder::Limits limits[] = {OverlapBuilder::Limits(11), OverlapBuilder::Limits(0, 2), OverlapBuilder::Limits(0, 0, 16)};
+    for (const auto& limit : limits) {
+        for (size_t threads = 1; threads <= 3; threads += 2) {
+            std::set<std::string> edges, aborted;
+            parseGraph(build(limit, threads), &edges, &aborted);
+            BOOST_CHECK(!aborted.empty());
+
+            std::set<std::string> kept;
+            for (const auto& line : expected) {
+                ASQG::EdgeRecord record;
+                BOOST_REQUIRE(ASQG::EdgeRecord::parse(line, record));
+                if (aborted.find(record.overlap().id[0]) == aborted.end() && aborted.find(record.overlap().id[1]) == aborted.end()) {
+                    kept.insert(line);
+                }
+            }
+            BOOST_CHECK(edges == kept);
+            BOOST_CHECK(edges.size() < expected.size());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(OverlapBuilder_shards) {
+    TempDir dir;
+    std::string prefix = dir.path("reads");
+    writeIndex(prefix, simulateReads());
+
+    FMIndex fmi, rfmi;
+    BOOST_REQUIRE(FMIndex::load(prefix + BWT_EXT, fmi) && FMIndex::load(prefix + RBWT_EXT, rfmi));
+
+    // The aborted reads of one shard have edges in the others
+    OverlapBuilder::Limits limits[] = {OverlapBuilder::Limits(), OverlapBuilder::Limits(0, 2)};
+    for (const auto& limit : limits) {
+        OverlapBuilder builder(&fmi, &rfmi, prefix, true, true, limit);
+        std::string expected = prefix + ASQG_EXT + GZIP_EXT;
+        BOOST_CHECK(builder.build(prefix + FA_EXT, 45, expected, 1));
+
+        // Shards of 10 reads at most, given in the order of a shell glob
+        const size_t n = 30;
+        std::vector<std::string> shards;
+        for (size_t i = 0; i < n; ++i) {
+            shards.push_back(OverlapBuilder::shardPrefix(prefix, i, n) + ASQG_EXT + GZIP_EXT);
+            BOOST_CHECK(builder.build(prefix + FA_EXT, 45, shards.back(), 1, 1000, i, n));
+        }
+        std::sort(shards.begin(), shards.end());
+        BOOST_CHECK(shards.front() != OverlapBuilder::shardPrefix(prefix, 0, n) + ASQG_EXT + GZIP_EXT);
+
+        std::string merged = prefix + "-merged" + ASQG_EXT + GZIP_EXT;
+        BOOST_CHECK(OverlapBuilder::merge(shards, merged));
+        BOOST_CHECK(readFile(merged) == readFile(expected));
+
+        // A missing, a duplicated shard or a shard of another run
+        std::vector<std::string> missing(shards.begin() + 1, shards.end());
+        BOOST_CHECK(!OverlapBuilder::merge(missing, merged));
+        std::vector<std::string> duplicated(shards);
+        duplicated.push_back(shards[1]);
+        BOOST_CHECK(!OverlapBuilder::merge(duplicated, merged));
+        std::string other = OverlapBuilder::shardPrefix(prefix, 0, n + 1) + ASQG_EXT + GZIP_EXT;
+        BOOST_CHECK(builder.build(prefix + FA_EXT, 45, other, 1, 1000, 0, n + 1));
+        missing.push_back(other);
+        BOOST_CHECK(!OverlapBuilder::merge(missing, merged));
+        // Not a shard
+        BOOST_CHECK(!OverlapBuilder::merge(std::vector<std::string>(1, expected), merged));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(OverlapBuilder_rmdup) {
+    TempDir dir;
+    std::string prefix = dir.path("reads");
+    writeIndex(prefix, simulateDuplicates());
+
+    FMIndex fmi, rfmi;
+    BOOST_REQUIRE(FMIndex::load(prefix + BWT_EXT, fmi) && FMIndex::load(prefix + RBWT_EXT, rfmi));
+    OverlapBuilder builder(&fmi, &rfmi, prefix);
+
+    // The output does not depend on the number of threads
+    std::string expected, dups;
+    for (size_t threads = 1; threads <= 4; ++threads) {
+        std::string output = boost::str(boost::format("%s-t%d") % prefix % threads);
+        BOOST_CHECK(builder.rmdup(prefix + FA_EXT, output + FA_EXT, output + ".dups" + FA_EXT, threads));
+        if (threads == 1) {
+            expected = readFile(output + FA_EXT);
+            dups = readFile(output + ".dups" + FA_EXT);
+            BOOST_CHECK(dups.find("seqrank=") != std::string::npos);
+        } else {
+            BOOST_CHECK(readFile(output + FA_EXT) == expected);
+            BOOST_CHECK(readFile(output + ".dups" + FA_EXT) == dups);
+        }
+    }
+
+    // Grouping the exact duplicates changes neither NumDuplicates nor the split
+    for (size_t threads = 1; threads <= 3; threads += 2) {
+        std::string output = boost::str(boost::format("%s-t%d-noprefilter") % prefix % threads);
+        BOOST_CHECK(builder.rmdup(prefix + FA_EXT, output + FA_EXT, output + ".dups" + FA_EXT, threads, NULL, false));
+        BOOST_CHECK(readFile(output + FA_EXT) == expected);
+        BOOST_CHECK(readFile(output + ".dups" + FA_EXT) == dups);
+    }
 }
 
 BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,334 @@
+#define BOOST_TEST_MODULE "siga.parallel"
+#include <boost/test/included/unit_test.hpp>
+
+#include "sequence_process_framework.h"
+#include "thread_pool.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(parallel);
+
+// Square the items, counting the items processed by each processor
+class SquareProcess {
+public:
+    size_t process(const size_t& item) {
+        ++processed;
+        return item * item;
+    }
+    size_t processed = 0;
+};
+
+// Square the items after a random delay, a few items take much longer
+class SlowProcess {
+public:
+    size_t process(const size_t& item) {
+        std::mt19937 rng(item);
+        size_t delay = rng() % 50 == 0 ? 2000 + rng() % 3000 : rng() % 100;
+        std::this_thread::sleep_for(std::chrono::microseconds(delay));
+        return item * item;
+    }
+};
+
+// Collect the outputs in the order they are post processed
+class CollectPostProcess {
+public:
+    void process(const size_t& item, const size_t& output) {
+        items.push_back(item);
+        outputs.push_back(output);
+    }
+    std::vector<size_t> items;
+    std::vector<size_t> outputs;
+};
+
+typedef SequenceProcessFramework::VectorWorkItemGenerator<size_t> Generator;
+
+static std::vector<size_t> makeItems(size_t n) {
+    std::vector<size_t> items;
+    for (size_t i = 0; i < n; ++i) {
+        items.push_back(i * 7 + 3);
+    }
+    return items;
+}
+
+BOOST_AUTO_TEST_CASE(ParallelWorker_run) {
+    std::vector<size_t> items = makeItems(5000);
+
+    CollectPostProcess expected;
+    {
+        SquareProcess proc;
+        Generator generator(items);
+        SequenceProcessFramework::SerialWorker<size_t, size_t, Generator, SquareProcess, CollectPostProcess> worker;
+        BOOST_CHECK_EQUAL(worker.run(generator, &proc, &expected), items.size());
+        BOOST_CHECK(expected.items == items);
+    }
+
+    // Batches of one item, fewer items than one batch and batches ending past the input
+    size_t batches[] = {1, 7, 1000, 10000};
+    for (size_t threads = 1; threads <= 4; ++threads) {
+        for (auto batch : batches) {
+            std::vector<SquareProcess> procs(threads);
+            std::vector<SquareProcess *> proclist;
+            for (auto& proc : procs) {
+                proclist.push_back(&proc);
+            }
+            CollectPostProcess postproc;
+            Generator generator(items);
+            SequenceProcessFramework::ParallelWorker<size_t, size_t, Generator, SquareProcess, CollectPostProcess> worker;
+            BOOST_CHECK_EQUAL(worker.run(generator, &proclist, &postproc, batch), items.size());
+            BOOST_CHECK(postproc.items == expected.items);
+            BOOST_CHECK(postproc.outputs == expected.outputs);
+
+            size_t processed = 0;
+            for (const auto& proc : procs) {
+                processed += proc.processed;
+            }
+            BOOST_CHECK_EQUAL(processed, items.size());
+        }
+    }
+
+    // Only the first n items
+    {
+        std::vector<SquareProcess> procs(3);
+        std::vector<SquareProcess *> proclist = {&procs[0], &procs[1], &procs[2]};
+        CollectPostProcess postproc;
+        Generator generator(items);
+        SequenceProcessFramework::ParallelWorker<size_t, size_t, Generator, SquareProcess, CollectPostProcess> worker;
+        BOOST_CHECK_EQUAL(worker.run(generator, &proclist, &postproc, 16, 100), 100);
+        BOOST_CHECK(postproc.items == std::vector<size_t>(items.begin(), items.begin() + 100));
+    }
+
+    // No items at all
+    {
+        std::vector<size_t> empty;
+        std::vector<SquareProcess> procs(2);
+        std::vector<SquareProcess *> proclist = {&procs[0], &procs[1]};
+        CollectPostProcess postproc;
+        Generator generator(empty);
+        SequenceProcessFramework::ParallelWorker<size_t, size_t, Generator, SquareProcess, CollectPostProcess> worker;
+        BOOST_CHECK_EQUAL(worker.run(generator, &proclist, &postproc, 10), 0);
+        BOOST_CHECK(postproc.items.empty());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ParallelWorker_slow) {
+    std::vector<size_t> items = makeItems(2000);
+
+    CollectPostProcess expected;
+    {
+        SlowProcess proc;
+        Generator generator(items);
+        SequenceProcessFramework::SerialWorker<size_t, size_t, Generator, SlowProcess, CollectPostProcess> worker;
+        worker.run(generator, &proc, &expected);
+    }
+
+    // The slow items complete out of order, the output is still in the input order
+    size_t batches[] = {1, 16};
+    for (size_t threads = 2; threads <= 8; threads *= 2) {
+        for (auto batch : batches) {
+            std::vector<SlowProcess> procs(threads);
+            std::vector<SlowProcess *> proclist;
+            for (auto& proc : procs) {
+                proclist.push_back(&proc);
+            }
+            CollectPostProcess postproc;
+            Generator generator(items);
+            SequenceProcessFramework::ParallelWorker<size_t, size_t, Generator, SlowProcess, CollectPostProcess> worker;
+            BOOST_CHECK_EQUAL(worker.run(generator, &proclist, &postproc, batch), items.size());
+            BOOST_CHECK(postproc.items == expected.items);
+            BOOST_CHECK(postproc.outputs == expected.outputs);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ReorderBuffer_small) {
+    // A buffer of 3 slots, the reader and the workers ask for 8 items at once
+    const size_t n = 1000, batch = 8, workers = 3;
+    SequenceProcessFramework::ReorderBuffer<size_t, size_t> buffer(3, workers);
+
+    // Boost.Test only checks on the main thread
+    std::atomic<bool> reserved(true);
+    std::thread reader([&] {
+            size_t i = 0;
+            while (i < n) {
+                size_t first, last;
+                buffer.reserve(batch, &first, &last);
+                if (first != i || first >= last || last > first + 3) {
+                    reserved = false;
+                }
+                for (; i < last && i < n; ++i) {
+                    buffer[i].input = i;
+                }
+                buffer.fill(i, i == n);
+            }
+        });
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < workers; ++t) {
+        threads.push_back(std::thread([&, t] {
+                std::mt19937 rng(t);
+                size_t first, last;
+                while (buffer.claim(batch, &first, &last)) {
+                    for (size_t k = first; k < last; ++k) {
+                        std::this_thread::sleep_for(std::chrono::microseconds(rng() % 50));
+                        buffer[k].output = buffer[k].input * buffer[k].input;
+                    }
+                    buffer.complete(first, last);
+                }
+            }));
+    }
+
+    size_t released = 0, first, last;
+    while (buffer.next(&first, &last)) {
+        BOOST_REQUIRE(first == released && first < last && last <= first + 3);
+        for (size_t k = first; k < last; ++k) {
+            BOOST_REQUIRE(buffer[k].input == k && buffer[k].output == k * k);
+        }
+        buffer.release(last);
+        released = last;
+    }
+    BOOST_CHECK_EQUAL(released, n);
+
+    reader.join();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    BOOST_CHECK(reserved);
+}
+
+BOOST_AUTO_TEST_CASE(BatchSizer_bounds) {
+    typedef SequenceProcessFramework::ParallelWorker<size_t, size_t, Generator, SquareProcess, CollectPostProcess>::BatchSizer BatchSizer;
+
+    size_t limits[] = {1, 2, 1000};
+    for (auto limit : limits) {
+        BatchSizer sizer(std::max(limit / 64, (size_t)1), limit);
+        // Free items, costly scheduling, free scheduling, preemption of a batch
+        // and items costing three orders of magnitude more or less than before
+        double samples[][3] = {
+            {1, 0, 1e-3}, {1, 1e-9, 1}, {1000, 1e-3, 1e-9}, {1, 1e-6, 0},
+            {10, 1e-5, 1e-6}, {10, 1e-2, 1e-6}, {10, 1e-8, 1e-6}, {3, 1e-7, 1e2}, {1, 1e-3, 1e-3}
+        };
+        for (size_t round = 0; round < 100; ++round) {
+            for (const auto& sample : samples) {
+                sizer.update((size_t)sample[0], sample[1], sample[2]);
+                BOOST_CHECK(1 <= sizer.size() && sizer.size() <= limit);
+            }
+        }
+        BOOST_CHECK(1 <= sizer.minimum() && sizer.minimum() <= sizer.maximum() && sizer.maximum() <= limit);
+    }
+
+    // The size follows the cost of the items
+    BatchSizer sizer(1, 1000);
+    for (size_t i = 0; i < 100; ++i) {
+        sizer.update(1, 1e-7, 1e-6);
+    }
+    BOOST_CHECK_EQUAL(sizer.size(), 1000);
+    for (size_t i = 0; i < 100; ++i) {
+        sizer.update(1, 1e-2, 1e-6);
+    }
+    BOOST_CHECK_EQUAL(sizer.size(), 1);
+    BOOST_CHECK_EQUAL(sizer.minimum(), 1);
+    BOOST_CHECK_EQUAL(sizer.maximum(), 1000);
+}
+
+BOOST_AUTO_TEST_CASE(ThreadPool_submit) {
+    // The pool is destroyed first, its workers may still be returning
+    std::vector<std::atomic<size_t> > counts(1000);
+    std::atomic<size_t> done(0), id(0);
+    std::atomic<bool> inside(true);
+
+    ThreadPool pool(4);
+    BOOST_CHECK_EQUAL(pool.size(), 4);
+    BOOST_CHECK_EQUAL(pool.id(), (size_t)-1);
+
+    // Every task runs once, on a worker of the pool
+    for (size_t i = 0; i < counts.size(); ++i) {
+        pool.submit([&, i] {
+                if (pool.id() >= pool.size()) {
+                    inside = false;
+                }
+                ++counts[i];
+                ++done;
+            });
+    }
+    while (done < counts.size()) {
+        std::this_thread::yield();
+    }
+    for (const auto& count : counts) {
+        BOOST_CHECK_EQUAL(count, 1);
+    }
+    BOOST_CHECK(inside);
+
+    // A worker is only known to its own pool
+    ThreadPool other(1);
+    pool.submit([&] {
+            id = other.id();
+            ++done;
+        });
+    while (done <= counts.size()) {
+        std::this_thread::yield();
+    }
+    BOOST_CHECK_EQUAL(id, (size_t)-1);
+}
+
+BOOST_AUTO_TEST_CASE(ThreadPool_steal) {
+    // The tasks submitted by a worker go to its own deque, the idle workers
+    // steal them
+    std::mutex mutex;
+    std::set<size_t> ids;
+    std::atomic<size_t> done(0);
+    ThreadPool pool(4);
+    pool.submit([&] {
+            for (size_t i = 0; i < 100; ++i) {
+                pool.submit([&] {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                        {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            ids.insert(pool.id());
+                        }
+                        ++done;
+                    });
+            }
+        });
+    while (done < 100) {
+        std::this_thread::yield();
+    }
+    BOOST_CHECK(ids.size() > 1);
+    BOOST_CHECK(*ids.rbegin() < pool.size());
+}
+
+BOOST_AUTO_TEST_CASE(TaskGroup_nested) {
+    // Every task waits for a group of its own, a waiting task runs the others
+    // instead of blocking, even with a single worker
+    for (size_t threads = 1; threads <= 3; ++threads) {
+        ThreadPool pool(threads);
+        std::atomic<size_t> leaves(0);
+        std::function<void(size_t)> split = [&](size_t depth) {
+            if (depth == 0) {
+                ++leaves;
+                return;
+            }
+            ThreadPool::TaskGroup group(pool);
+            for (size_t i = 0; i < 4; ++i) {
+                group.run([&, depth] {
+                        split(depth - 1);
+                    });
+            }
+            group.wait();
+        };
+
+        ThreadPool::TaskGroup group(pool);
+        group.run([&] {
+                split(4);
+            });
+        group.wait();
+        BOOST_CHECK_EQUAL(leaves, 256);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -1,14 +1,22 @@
 #define BOOST_TEST_MODULE "siga.preprocess"
 #include <boost/test/included/unit_test.hpp>
 
+#include <fstream>
 #include <iostream>
+#include <random>
 #include <sstream>
+#include <type_traits>
 
 #include <boost/format.hpp>
 
+#include "kmer.h"
 #include "kseq.h"
 #include "reads.h"
 #include "primer_screen.h"
+#include "runner.h"
+#include "utils.h"
+
+#include "test_utils.h"
 
 BOOST_AUTO_TEST_SUITE(preprocess);
 
@@ -27,6 +35,40 @@ BOOST_AUTO_TEST_CASE(PrimerScreen_contains) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(AdapterScreen_find) {
+    std::vector<std::string> adapters = {"AGATCGGAAGAGCACACGTCTGAACTCCAGTCA", "CTGTCTCTTATACACATCT"};
+    std::string insert = "TTGCAGGCTACCGTTAGCAATCCGAT";
+    AdapterScreen::Hit hit;
+    {
+        AdapterScreen screen(adapters);
+        BOOST_CHECK(!screen.find(insert));
+        BOOST_CHECK(screen.find(insert + adapters[1] + "GG", &hit));
+        BOOST_CHECK_EQUAL(hit.adapter, 1);
+        BOOST_CHECK_EQUAL(hit.pos, insert.length());
+        // A prefix of an adapter at the end is only trimmed
+        BOOST_CHECK(!screen.find(insert + adapters[0].substr(0, 12)));
+        BOOST_CHECK_EQUAL(screen.trimLength(insert + adapters[0].substr(0, 12), 10), insert.length());
+        BOOST_CHECK_EQUAL(screen.trimLength(insert + adapters[0].substr(0, 8), 10), insert.length() + 8);
+    }
+    {
+        // Seeds of 8 bases with 2 mismatches
+        AdapterScreen screen(adapters, 8, 2);
+        std::string adapter = adapters[0];
+        adapter[3] = 'A';
+        adapter[20] = 'G';
+        BOOST_CHECK(screen.find(insert + adapter, &hit));
+        BOOST_CHECK_EQUAL(hit.adapter, 0);
+        BOOST_CHECK_EQUAL(hit.pos, insert.length());
+        BOOST_CHECK_EQUAL(hit.mismatches, 2);
+        adapter[10] = 'T';
+        BOOST_CHECK(!screen.find(insert + adapter));
+        // The read starts in an adapter
+        BOOST_CHECK(screen.find(adapters[1].substr(5) + insert, &hit));
+        BOOST_CHECK_EQUAL(hit.pos, -5);
+        BOOST_CHECK_EQUAL(screen.trimLength(adapters[1].substr(5) + insert, 10), 0);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(KSeq_transform) {
     DNASeq seq("test BX:Z:ACGT", "ACGTGAC");
     BOOST_CHECK_EQUAL(seq.name, "test");
@@ -42,6 +84,132 @@ BOOST_AUTO_TEST_CASE(KSeq_transform) {
     std::cout << boost::format("%1%::KSeq_transform seq: %2%") % BOOST_TEST_MODULE % seq;
 }
 
+BOOST_AUTO_TEST_CASE(KSeq_swap) {
+    // Moved rather than copied, also when a DNASeqList grows
+    BOOST_CHECK(std::is_nothrow_move_constructible<DNASeq>::value);
+    BOOST_CHECK(std::is_nothrow_move_assignable<DNASeq>::value);
+
+    // The buffers are exchanged, not copied
+    DNASeq a("a comment", std::string(1000, 'A'), std::string(1000, 'I')), b("b", "TT");
+    const char* buffer = a.seq.data();
+    a.swap(b);
+    BOOST_CHECK_EQUAL(a.name, "b");
+    BOOST_CHECK_EQUAL(a.seq, "TT");
+    BOOST_CHECK(a.quality.empty() && a.comment.empty());
+    BOOST_CHECK_EQUAL(b.name, "a");
+    BOOST_CHECK_EQUAL(b.comment, "comment");
+    BOOST_CHECK_EQUAL(b.quality, std::string(1000, 'I'));
+    BOOST_CHECK(b.seq.data() == buffer);
+}
+
+BOOST_AUTO_TEST_CASE(KSeq_reverse_complement) {
+    BOOST_CHECK_EQUAL(make_dna_reverse_complement_copy("ACGTNacgtn-"), "-nacgtNACGT");
+    // Every length around the vector widths, in place and into a buffer
+    const std::string alphabet = "ACGTNacgtnRY.";
+    std::string rc;
+    for (size_t n = 0; n < 100; ++n) {
+        std::string seq, expected;
+        for (size_t i = 0; i < n; ++i) {
+            seq += alphabet[(i * 7 + n) % alphabet.length()];
+        }
+        for (size_t i = n; i > 0; --i) {
+            expected += make_dna_complement(seq[i - 1]);
+        }
+        make_dna_reverse_complement_copy(seq, rc);
+        BOOST_CHECK_EQUAL(rc, expected);
+        make_dna_complement(rc);
+        BOOST_CHECK_EQUAL(rc, make_dna_reverse_copy(seq));
+        make_dna_reverse_complement(seq);
+        BOOST_CHECK_EQUAL(seq, expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Kmer_pack) {
+    Kmer kmer;
+    BOOST_CHECK(Kmer::pack("ACGTTG", 6, &kmer));
+    BOOST_CHECK_EQUAL(kmer.str(), "ACGTTG");
+    BOOST_CHECK_EQUAL(kmer.reverseComplement().str(), "CAACGT");
+    BOOST_CHECK_EQUAL(kmer.canonical().str(), "ACGTTG");
+    kmer.push(Kmer::code('A'));
+    BOOST_CHECK_EQUAL(kmer.str(), "CGTTGA");
+    BOOST_CHECK(!Kmer::pack("ACNT", 4, &kmer));
+
+    // Every k-mer of a packed sequence spanning the word boundaries
+    std::string seq;
+    for (size_t i = 0; i < 100; ++i) {
+        seq += "ACGT"[(i * i + 3 * i) % 4];
+    }
+    seq[70] = 'N';
+    PackedSeq packed(seq);
+    BOOST_CHECK_EQUAL(packed.str(), seq);
+    for (size_t k = 1; k <= Kmer::kMaxSize; ++k) {
+        for (size_t i = 0; i + k <= seq.length(); ++i) {
+            std::string w = seq.substr(i, k);
+            BOOST_CHECK_EQUAL(packed.masked(i, k), w.find('N') != std::string::npos);
+            if (!packed.masked(i, k)) {
+                Kmer kmer = packed.kmer(i, k);
+                BOOST_CHECK_EQUAL(kmer.str(), w);
+                BOOST_CHECK_EQUAL(kmer.reverseComplement().str(), make_dna_reverse_complement_copy(w));
+            }
+        }
+    }
+    packed.set(70, 'G');
+    BOOST_CHECK(!packed.masked(0, seq.length()));
+    BOOST_CHECK_EQUAL(packed[70], 'G');
+}
+
+BOOST_AUTO_TEST_CASE(Quality_kernels) {
+    // Every length around the vector widths against the scalar loops
+    Quality::PositionStats stats;
+    std::vector<size_t> sums, q30s, counts;
+    for (size_t n = 0; n < 600; ++n) {
+        std::string quality;
+        for (size_t i = 0; i < n; ++i) {
+            quality += (char)(33 + (i * 7 + n * 13) % 42 - (i % 97 == 5 ? 3 : 0));
+        }
+
+        size_t low = 0;
+        for (auto c : quality) {
+            low += (int)(uint8_t)c - 33 <= 3 ? 1 : 0;
+        }
+        BOOST_CHECK_EQUAL(Quality::countAtMost(quality.data(), n, 3), low);
+
+        for (int threshold = 10; threshold <= 40; threshold += 15) {
+            size_t endpoint = n;
+            if (n > 0 && (int)(uint8_t)quality[n - 1] - 33 < threshold) {
+                int sum = 0, max = 0;
+                endpoint = 0;
+                for (size_t i = n; i > 0; --i) {
+                    sum += threshold - ((int)(uint8_t)quality[i - 1] - 33);
+                    if (sum > max) {
+                        max = sum;
+                        endpoint = i;
+                    }
+                }
+            }
+            BOOST_CHECK_EQUAL(Quality::trimLength(quality.data(), n, threshold), endpoint);
+        }
+
+        stats.add(quality.data(), n);
+        sums.resize(std::max(sums.size(), n));
+        q30s.resize(sums.size());
+        counts.resize(sums.size());
+        for (size_t i = 0; i < n; ++i) {
+            int q = std::max((int)(uint8_t)quality[i] - 33, 0);
+            sums[i] += q;
+            q30s[i] += q >= 30 ? 1 : 0;
+            ++counts[i];
+        }
+    }
+    stats.flush();
+    BOOST_CHECK_EQUAL(stats.length(), sums.size());
+    for (size_t i = 0; i < sums.size(); ++i) {
+        BOOST_CHECK_EQUAL(stats.sum(i), sums[i]);
+        BOOST_CHECK_EQUAL(stats.q30(i), q30s[i]);
+        BOOST_CHECK_EQUAL(stats.count(i), counts[i]);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(KSeq_read) {
     // FASTA
     {
@@ -57,6 +225,38 @@ BOOST_AUTO_TEST_CASE(KSeq_read) {
     // FASTQ
 }
 
+BOOST_AUTO_TEST_CASE(KSeq_parallel_read) {
+    // Quality lines starting with '@' and '+' must not be taken for records
+    std::string fastq;
+    for (size_t i = 0; i < 100; ++i) {
+        fastq += boost::str(boost::format("@read%d\nACGTACGT\n+\n%s\n") % i % (i % 2 == 0 ? "@IIII+II" : "+IIII@II"));
+    }
+    TempDir dir;
+    std::string file = dir.path("reads.fq");
+    {
+        std::ofstream stream(file);
+        stream << fastq;
+    }
+
+    DNASeqList expected;
+    {
+        std::stringstream stream(fastq);
+        BOOST_CHECK(ReadDNASequences(stream, expected));
+    }
+    // Chunks of 17 bytes cut every record
+    ParallelDNASeqReader reader(file, 3, 17);
+    DNASeq seq;
+    size_t i = 0;
+    while (reader.read(seq)) {
+        BOOST_CHECK(i < expected.size());
+        BOOST_CHECK_EQUAL(seq.name, expected[i].name);
+        BOOST_CHECK_EQUAL(seq.quality, expected[i].quality);
+        ++i;
+    }
+    BOOST_CHECK_EQUAL(i, expected.size());
+    BOOST_CHECK(!reader.failed());
+}
+
 BOOST_AUTO_TEST_CASE(PairEnd_test) {
     BOOST_CHECK_EQUAL("R", PairEnd::basename("R/1"));
     BOOST_CHECK_EQUAL("R", PairEnd::basename("R/A"));
@@ -70,4 +270,51 @@ BOOST_AUTO_TEST_CASE(PairEnd_test) {
     BOOST_CHECK_EQUAL("R/f", PairEnd::id("R/r"));
 }
 
+BOOST_AUTO_TEST_CASE(Preprocess_threads) {
+    // Pairs of reads with low quality tails, some with an N, in two files and
+    // interleaved in a third one
+    TempDir dir;
+    std::string file1 = dir.path("reads_1.fq"), file2 = dir.path("reads_2.fq"), interleaved = dir.path("reads.fq");
+    {
+        std::mt19937 rng(3);
+        std::ofstream stream1(file1), stream2(file2), stream(interleaved);
+        for (size_t i = 0; i < 3000; ++i) {
+            std::string records[2];
+            for (size_t k = 0; k < 2; ++k) {
+                std::string seq, quality;
+                for (size_t j = 0; j < 100; ++j) {
+                    seq += rng() % 500 == 0 ? 'N' : "ACGT"[rng() % 4];
+                    quality += j >= 100 - rng() % 70 ? '#' : 'I';
+                }
+                records[k] = boost::str(boost::format("@read%d/%d\n%s\n+\n%s\n") % i % (k + 1) % seq % quality);
+            }
+            stream1 << records[0];
+            stream2 << records[1];
+            stream << records[0] << records[1];
+        }
+    }
+
+    auto preprocess = [&](const std::string& mode, size_t threads, const std::string& seed, const Arguments& inputs) {
+        std::string output = dir.path(boost::str(boost::format("out-%s-%d-%s.fq") % mode % threads % seed));
+        BOOST_CHECK_EQUAL(runCommand("preprocess", {"out=" + output, "pe-mode=" + mode, boost::str(boost::format("threads=%d") % threads), "quality-trim=20", "min-length=60", "sample-rate=0.5", "sample-seed=" + seed}, inputs), 0);
+        return readFile(output);
+    };
+
+    // The same reads are kept and sampled for any number of threads
+    std::string single = preprocess("0", 1, "7", {file1});
+    BOOST_CHECK(!single.empty());
+    BOOST_CHECK(single.length() < readFile(file1).length() / 3);
+    BOOST_CHECK(preprocess("0", 1, "8", {file1}) != single);
+
+    std::string paired = preprocess("1", 1, "7", {file1, file2});
+    BOOST_CHECK(!paired.empty());
+    for (size_t threads = 2; threads <= 5; threads += 3) {
+        BOOST_CHECK(preprocess("0", threads, "7", {file1}) == single);
+        BOOST_CHECK(preprocess("1", threads, "7", {file1, file2}) == paired);
+        // Interleaved pairs
+        BOOST_CHECK(preprocess("2", threads, "7", {interleaved}) == paired);
+    }
+    BOOST_CHECK(preprocess("2", 1, "7", {interleaved}) == paired);
+}
+
 BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,77 @@
+#ifndef test_utils_h_
+#define test_utils_h_
+
+// The helpers shared by the test programs, included after the Boost.Test header
+
+#include "kseq.h"
+#include "runner.h"
+#include "utils.h"
+
+#include <fstream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+// A directory of its own under the temporary directory, removed with all its
+// files when the test case ends, even on a failed BOOST_REQUIRE
+class TempDir {
+public:
+    TempDir() : _dir(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()) {
+        boost::filesystem::create_directories(_dir);
+    }
+    ~TempDir() {
+        boost::system::error_code ec;
+        boost::filesystem::remove_all(_dir, ec);
+    }
+    TempDir(const TempDir&) = delete;
+    TempDir& operator=(const TempDir&) = delete;
+
+    std::string path(const std::string& name) const {
+        return (_dir / name).string();
+    }
+private:
+    boost::filesystem::path _dir;
+};
+
+// The content of a file, decompressed as siga reads it unless binary
+inline std::string readFile(const std::string& file, bool binary=false) {
+    std::shared_ptr<std::istream> stream(binary ? new std::ifstream(file, std::ios::binary) : Utils::ifstream(file));
+    BOOST_REQUIRE(stream && *stream);
+    std::stringstream ss;
+    ss << stream->rdbuf();
+    return ss.str();
+}
+
+inline void writeReads(const std::string& file, const DNASeqList& reads) {
+    std::ofstream stream(file);
+    for (const auto& read : reads) {
+        stream << read;
+    }
+}
+
+inline std::string simulateGenome(size_t length, size_t seed) {
+    std::mt19937 rng(seed);
+    std::string genome;
+    for (size_t i = 0; i < length; ++i) {
+        genome += "ACGT"[rng() % 4];
+    }
+    return genome;
+}
+
+// Run a command as siga does, the options are given as key=value
+inline int runCommand(const std::string& name, const std::vector<std::string>& options, const Arguments& arguments) {
+    RunnerPtr runner = RunnerManager::get()->create(name);
+    BOOST_REQUIRE(runner);
+    Properties properties;
+    for (const auto& option : options) {
+        size_t pos = option.find('=');
+        properties.put(option.substr(0, pos), pos != std::string::npos ? option.substr(pos + 1) : "");
+    }
+    return runner->run(properties, arguments);
+}
+
+#endif // test_utils_h_